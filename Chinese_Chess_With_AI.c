@@ -140,7 +140,7 @@ PieceSide piece_side_reverse(PieceSide s) {
 #define BOARD_9_PALACE_DOWN_RIGHT   (BOARD_ACTUAL_COL_BEGIN + 5)
 
 #define CNCHESS_HISTORY_PRE_ALLOC_CAPACITY   128
-#define CNCHESS_MOVES_PRE_ALLOC_CAPACITY   256
+#define CNCHESS_MOVES_MAX_LEN   256
 
 typedef struct MoveNode {
     int beginRow, beginCol, endRow, endCol;
@@ -290,10 +290,13 @@ void board_undo(ChessBoard* cb) {
 }
 
 /************************************ moves generator. **************************************/
+/* 
+    fixed capacity, so a Moves can live on the stack or in a pre-allocated search stack,
+    and generating moves never calls malloc().
+*/
 typedef struct Moves {
-    MoveNode* data;
+    MoveNode data[CNCHESS_MOVES_MAX_LEN];
     int length;
-    int capacity;
 } Moves;
 
 Moves* moves_create_new(void) {
@@ -302,40 +305,21 @@ Moves* moves_create_new(void) {
         log_error_die("can't create moves: memory is not enough.\n");
     }
 
-    moves->capacity = CNCHESS_MOVES_PRE_ALLOC_CAPACITY;
     moves->length = 0;
-
-    moves->data = (MoveNode*)malloc(moves->capacity * sizeof(MoveNode));
-    if (moves->data == NULL) {
-        log_error_die("can't allocate moves data: memory is not enough.\n");
-    }
-
     return moves;
 }
 
 void moves_destroy(Moves* moves) {
-    if (moves != NULL) {
-        free(moves->data);
-        free(moves);
-    }
+    free(moves);
 }
 
-void moves_add(Moves* moves, int beginRow, int beginCol, int endRow, int endCol) {
-    MoveNode* temp;
-    MoveNode* m;
-    
-    if (moves->length == moves->capacity) {
-        int newCapacity = 2 * moves->capacity;
-        temp = (MoveNode*)realloc(moves->data, newCapacity * sizeof(MoveNode));
-        if (temp == NULL) {
-            log_error_die("can't expand moves capacity: memory is not enough.\n");
-        }
+void moves_clear(Moves* moves) {
+    moves->length = 0;
+}
 
-        moves->data = temp;
-        moves->capacity = newCapacity;
-    }
+void moves_add(Moves* moves, int beginRow, int beginCol, int endRow, int endCol) {
+    MoveNode* m = &(moves->data[moves->length]);
 
-    m = &(moves->data[moves->length]);
     m->beginRow = beginRow;
     m->beginCol = beginCol;
     m->endRow = endRow;
@@ -645,17 +629,15 @@ void gen_moves_general(ChessBoard* cb, Moves* moves, int r, int c, PieceSide s)
     }
 }
 
-Moves* gen_moves(ChessBoard* cb, PieceSide s) {
+/* 
+    generate moves of side s into a caller provided moves, the old moves in it are cleared.
+    param: PieceSide s can't be PS_Extra.
+*/
+void gen_moves_into(ChessBoard* cb, PieceSide s, Moves* moves) {
     Piece p;
     int r, c;
 
-    Moves* moves;
-    
-    if (s == PS_Extra) {
-        return NULL;
-    }
-
-    moves = moves_create_new();
+    moves_clear(moves);
     for (r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r) {
         for (c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c) {
             p = cb->data[r][c];
@@ -691,7 +673,21 @@ Moves* gen_moves(ChessBoard* cb, PieceSide s) {
             }
         }
     }
+}
+
+/* 
+    generate moves of side s, you should call moves_destroy() on the returned value later.
+    the searching uses gen_moves_into() with a pre-allocated stack instead.
+*/
+Moves* gen_moves(ChessBoard* cb, PieceSide s) {
+    Moves* moves;
+    
+    if (s == PS_Extra) {
+        return NULL;
+    }
 
+    moves = moves_create_new();
+    gen_moves_into(cb, s, moves);
     return moves;
 }
 
@@ -938,11 +934,13 @@ long compare_max(long left, long right) {
 
 /*
     the smaller, the better for ai, the bigger, the better for user.
+    movesStack points to the moves buffer of this ply, deeper plies use the following buffers,
+    so it must have at least searchDepth elements.
     param: PieceSide s can't be PS_Extra.
 */
-long min_max(ChessBoard* cb, unsigned int searchDepth, int alpha, int beta, PieceSide s) {
+long min_max(ChessBoard* cb, Moves* movesStack, unsigned int searchDepth, int alpha, int beta, PieceSide s) {
     long minValue, maxValue;
-    Moves* moves;
+    Moves* moves = movesStack;
     MoveNode* mv;
     int i;
 
@@ -952,13 +950,13 @@ long min_max(ChessBoard* cb, unsigned int searchDepth, int alpha, int beta, Piec
 
     if (s == PS_Up) {
         minValue = BOARD_SCORE_MAX;
-        moves = gen_moves(cb, s);
+        gen_moves_into(cb, s, moves);
 
         for (i = 0; i < moves->length; ++i) {
             mv = &(moves->data[i]);
 
             board_move(cb, mv);
-            minValue = compare_min(minValue, min_max(cb, searchDepth - 1, alpha, beta, PS_Down));
+            minValue = compare_min(minValue, min_max(cb, movesStack + 1, searchDepth - 1, alpha, beta, PS_Down));
             board_undo(cb);
 
             beta = compare_min(beta, minValue);
@@ -967,18 +965,17 @@ long min_max(ChessBoard* cb, unsigned int searchDepth, int alpha, int beta, Piec
             }
         }
 
-        moves_destroy(moves);
         return minValue;
     }
     else {
         maxValue = BOARD_SCORE_MIN;
-        moves = gen_moves(cb, s);
+        gen_moves_into(cb, s, moves);
 
         for (i = 0; i < moves->length; ++i) {
             mv = &(moves->data[i]);
 
             board_move(cb, mv);
-            maxValue = compare_max(maxValue, min_max(cb, searchDepth - 1, alpha, beta, PS_Up));
+            maxValue = compare_max(maxValue, min_max(cb, movesStack + 1, searchDepth - 1, alpha, beta, PS_Up));
             board_undo(cb);
 
             alpha = compare_max(alpha, maxValue);
@@ -987,7 +984,6 @@ long min_max(ChessBoard* cb, unsigned int searchDepth, int alpha, int beta, Piec
             }
         }
 
-        moves_destroy(moves);
         return maxValue;
     }
 }
@@ -995,19 +991,28 @@ long min_max(ChessBoard* cb, unsigned int searchDepth, int alpha, int beta, Piec
 MoveNode gen_best_move_for(ChessBoard* cb, PieceSide s /* can't be PS_Extra */, unsigned int searchDepth) {
     long value, minValue, maxValue;
     Moves* moves;
+    Moves* movesStack;
     MoveNode* mv;
     MoveNode bestMove;
     int i;
 
+    /* one buffer for the root, and one for every ply of min_max(), allocated once for the whole search. */
+    movesStack = (Moves*)malloc((searchDepth + 1) * sizeof(Moves));
+    if (movesStack == NULL) {
+        log_error_die("can't allocate moves stack: memory is not enough.\n");
+    }
+
+    moves = movesStack;
+    gen_moves_into(cb, s, moves);
+
     if (s == PS_Up) {
         minValue = BOARD_SCORE_MAX;
-        moves = gen_moves(cb, s);
 
         for (i = 0; i < moves->length; ++i) {
             mv = &(moves->data[i]);
 
             board_move(cb, mv);
-            value = min_max(cb, searchDepth, BOARD_SCORE_MIN, BOARD_SCORE_MAX, PS_Down);
+            value = min_max(cb, movesStack + 1, searchDepth, BOARD_SCORE_MIN, BOARD_SCORE_MAX, PS_Down);
             board_undo(cb);
 
             if (value <= minValue) {
@@ -1015,19 +1020,15 @@ MoveNode gen_best_move_for(ChessBoard* cb, PieceSide s /* can't be PS_Extra */,
                 memcpy(&bestMove, mv, sizeof(MoveNode));
             }
         }
-
-        moves_destroy(moves);
-        return bestMove;
     }
     else {
         maxValue = BOARD_SCORE_MIN;
-        moves = gen_moves(cb, s);
 
         for (i = 0; i < moves->length; ++i) {
             mv = &(moves->data[i]);
 
             board_move(cb, mv);
-            value = min_max(cb, searchDepth, BOARD_SCORE_MIN, BOARD_SCORE_MAX, PS_Up);
+            value = min_max(cb, movesStack + 1, searchDepth, BOARD_SCORE_MIN, BOARD_SCORE_MAX, PS_Up);
             board_undo(cb);
 
             if (value >= maxValue) {
@@ -1035,10 +1036,10 @@ MoveNode gen_best_move_for(ChessBoard* cb, PieceSide s /* can't be PS_Extra */,
                 memcpy(&bestMove, mv, sizeof(MoveNode));
             }
         }
-
-        moves_destroy(moves);
-        return bestMove;
     }
+
+    free(movesStack);
+    return bestMove;
 }
 
 /************************************** string. *****************************************/
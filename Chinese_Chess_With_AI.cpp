@@ -4,15 +4,57 @@
 */
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <array>
 #include <vector>
 #include <deque>
 #include <algorithm>
 #include <limits>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cctype>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+    build with DEBUG_CHECK defined(cmake option USING_DEBUG_CHECK) to cross-check every
+    incrementally updated state with a full recomputation, it is slow, only for debugging.
+*/
+#ifdef DEBUG_CHECK
+constexpr bool DEBUG_CHECK_ENABLED = true;
+#else
+constexpr bool DEBUG_CHECK_ENABLED = false;
+#endif
+
+/*
+    build with BITBOARD_MOVEGEN defined(cmake option USING_BITBOARD) to generate moves with bitboards,
+    the mailbox generator is always compiled, the debug check build compares both of them.
+*/
+#ifdef BITBOARD_MOVEGEN
+constexpr bool BITBOARD_MOVEGEN_ENABLED = true;
+#else
+constexpr bool BITBOARD_MOVEGEN_ENABLED = false;
 #endif
 
 /*
@@ -46,12 +88,142 @@ constexpr int32_t BOARD_9_PALACE_DOWN_BOTTOM  = BOARD_ACTUAL_ROW_BEGIN + 9;
 constexpr int32_t BOARD_9_PALACE_DOWN_LEFT    = BOARD_ACTUAL_COL_BEGIN + 3;
 constexpr int32_t BOARD_9_PALACE_DOWN_RIGHT   = BOARD_ACTUAL_COL_BEGIN + 5;
 
+/*
+    a square is indexed by r * BOARD_ACTUAL_COL_LEN + c on the 14 x 13 board, so every square fits in 8 bits,
+    and moving one step up, down, left or right is adding a fixed offset.
+*/
+constexpr int32_t BOARD_SQUARE_LEN = BOARD_ACTUAL_ROW_LEN * BOARD_ACTUAL_COL_LEN;
+
+constexpr int32_t SQUARE_UP_OFFSET    = -BOARD_ACTUAL_COL_LEN;
+constexpr int32_t SQUARE_DOWN_OFFSET  = +BOARD_ACTUAL_COL_LEN;
+constexpr int32_t SQUARE_LEFT_OFFSET  = -1;
+constexpr int32_t SQUARE_RIGHT_OFFSET = +1;
+
+constexpr int32_t square_make(int32_t r, int32_t c){
+    return r * BOARD_ACTUAL_COL_LEN + c;
+}
+
+constexpr int32_t square_get_row(int32_t sq){
+    return sq / BOARD_ACTUAL_COL_LEN;
+}
+
+constexpr int32_t square_get_col(int32_t sq){
+    return sq % BOARD_ACTUAL_COL_LEN;
+}
+
+constexpr bool square_is_on_board(int32_t sq){
+    return square_get_row(sq) >= BOARD_ACTUAL_ROW_BEGIN && square_get_row(sq) <= BOARD_ACTUAL_ROW_END &&
+           square_get_col(sq) >= BOARD_ACTUAL_COL_BEGIN && square_get_col(sq) <= BOARD_ACTUAL_COL_END;
+}
+
+/*
+    bitboards index the 90 playable squares from 0, row by row, without the padding,
+    bit 0 - 63 are stored in the first word, bit 64 - 89 are stored in the second word.
+*/
+constexpr int32_t BOARD_INDEX_LEN = BOARD_ROW_LEN * BOARD_COL_LEN;
+
 // The max number of steps a player can take in a single turn.
 constexpr int32_t MAX_ONE_SIDE_POSSIBLE_MOVES_LEN = 256;
 
+// max number of plies from the root, including everything a search may add beyond its depth.
+constexpr int32_t MAX_SEARCH_PLY = 128;
+
+// pre-allocated history length of a chess board, so making moves doesn't allocate memory.
+constexpr size_t HISTORY_PRE_ALLOC_CAPACITY = 512;
+
 // default AI difficulty.
 constexpr uint16_t DEFAULT_AI_SEARCH_DEPTH = 4;
 
+// max search depth of iterative deepening.
+constexpr uint16_t MAX_SEARCH_DEPTH = 64;
+
+// the clock is checked once every this many nodes when a search is time limited, must be power of two.
+constexpr uint64_t SEARCH_CHECK_TIME_NODES = 1024;
+
+// default transposition table size, in MB.
+constexpr size_t DEFAULT_TRANSPOSITION_TABLE_SIZE_MB = 16;
+
+// the transposition table size is clamped to 1 ~ this, in MB.
+constexpr size_t MAX_TRANSPOSITION_TABLE_SIZE_MB = 4096;
+
+// the most AI searching threads --threads takes.
+constexpr uint32_t MAX_SEARCH_THREADS = 256;
+
+// number of killer moves kept for every ply.
+constexpr size_t KILLER_MOVES_PER_PLY = 2;
+
+// when a history score reaches this, the whole history table is halved.
+constexpr int32_t MOVE_HISTORY_MAX = 1 << 24;
+
+// max nodes of one quiescence search, the rest of it returns the static score.
+constexpr uint32_t QUIESCENCE_MAX_NODES = 1024;
+
+// a capture is skipped in quiescence search if even winning the piece plus this can't improve the score.
+constexpr int32_t QUIESCENCE_DELTA_MARGIN = 100;
+
+// bigger than every score, scores are negated by the negamax search, so -SEARCH_INFINITY is the lowest one.
+constexpr int32_t SEARCH_INFINITY = std::numeric_limits<int32_t>::max();
+
+/*
+    score of the side to move when it has no legal move, checkmated or stalemated, both lose.
+    a node mated at ply n from the root scores -(SCORE_MATE - n), so a quicker mate is preferred,
+    every score beyond SCORE_MATE_BOUND is a mate score. it fits the 16 bits score of the transposition table.
+*/
+constexpr int32_t SCORE_MATE = 30000;
+constexpr int32_t SCORE_MATE_BOUND = SCORE_MATE - MAX_SEARCH_PLY;
+
+// half width of the first aspiration window around the previous iteration's score, it doubles on every fail.
+constexpr int32_t ASPIRATION_WINDOW = 30;
+
+// first bytes of an opening book file.
+constexpr char BOOK_MAGIC[8] = { 'X', 'Q', 'B', 'O', 'O', 'K', '1', '\0' };
+
+// an opening book is built from the first BOOK_MAX_PLY moves of every game.
+constexpr uint16_t BOOK_MAX_PLY = 20;
+
+// first bytes of a game statistics file.
+constexpr char GAME_STATS_MAGIC[8] = { 'X', 'Q', 'S', 'T', 'A', 'T', '1', '\0' };
+
+// game statistics are collected from the first GAME_STATS_MAX_PLY moves of every game.
+constexpr uint16_t GAME_STATS_MAX_PLY = 40;
+
+// GameStatsTable has 1 << GAME_STATS_SHARD_BITS locked shards, more shards, less waiting for each other.
+constexpr uint32_t GAME_STATS_SHARD_BITS = 6;
+
+// slots of a GameStatsTable shard at first, power of two, it doubles when it is 70% full.
+constexpr size_t GAME_STATS_SHARD_INITIAL_SLOTS = 1024;
+
+// a games file is replayed in chunks of this size, one thread a chunk.
+constexpr size_t GAME_STATS_CHUNK_SIZE = 1 << 20;
+
+// first bytes of an endgame tablebase file.
+constexpr char TABLEBASE_MAGIC[8] = { 'X', 'Q', 'T', 'B', '1', '\0', '\0', '\0' };
+
+// a table of an endgame tablebase has both generals and up to TABLEBASE_MAX_PIECES other pieces.
+constexpr uint32_t TABLEBASE_MAX_PIECES = 5;
+
+// positions of the biggest table which can be generated, the generation needs 2 bytes for each.
+constexpr uint64_t TABLEBASE_MAX_POSITIONS = 1ULL << 29;
+
+/*
+    a tablebase keeps one byte for every position, below TABLEBASE_ILLEGAL it is the distance to mate in plies,
+    odd if the side to move mates, even if it is mated(0 if it is already), like the search, stalemated is mated.
+*/
+constexpr uint8_t TABLEBASE_ILLEGAL = 254;    // two pieces on one square, or the side not to move is in check.
+constexpr uint8_t TABLEBASE_DRAW = 255;       // neither side can force a mate.
+
+// positions of a table are generated in chunks of this size, one thread a chunk.
+constexpr size_t TABLEBASE_CHUNK_SIZE = 1 << 16;
+
+// in UCCI mode, a "go" with only the remaining time spends 1 / UCCI_DEFAULT_MOVES_TO_GO of it on this move.
+constexpr uint32_t UCCI_DEFAULT_MOVES_TO_GO = 30;
+
+// in UCCI mode, the time kept back from the remaining time for the communication with the interface, in ms.
+constexpr uint32_t UCCI_TIME_MARGIN_MS = 50;
+
+// max number of pieces of one kind on the chess board, there are 5 pawns for each side.
+constexpr int32_t MAX_ONE_KIND_PIECES_LEN = 5;
+
 // piece side.
 enum PieceSide{
     PS_UP,         // upper side player.
@@ -72,8 +244,8 @@ enum PieceType{
     PT_OUT         // out of chess board.
 };
 
-// piece, it is only used as an integer, so there's no need to use enum class(C++11).
-enum Piece{
+// piece, it is only used as an integer, so there's no need to use enum class(C++11), 8 bits is enough.
+enum Piece : uint8_t {
     P_UP,              // upper pawn.
     P_UC,              // upper cannon.
     P_UR,              // upper rook.
@@ -367,945 +539,5486 @@ constexpr int32_t piece_get_pos_value(Piece p, int32_t r, int32_t c){
     return piecePosValueMapping[p][r][c];
 }
 
-/* 
-    a default chess board, used as a template for new board.
-    P_EO is used here for speeding up rules checking.
-*/
-constexpr Piece DEFAULT_CHESS_BOARD_DATA[BOARD_ACTUAL_ROW_LEN][BOARD_ACTUAL_COL_LEN] = {
-    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
-    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
-    { P_EO, P_EO, P_UR, P_UN, P_UB, P_UA, P_UG, P_UA, P_UB, P_UN, P_UR, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_UC, P_EE, P_EE, P_EE, P_EE, P_EE, P_UC, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_UP, P_EE, P_UP, P_EE, P_UP, P_EE, P_UP, P_EE, P_UP, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_DP, P_EE, P_DP, P_EE, P_DP, P_EE, P_DP, P_EE, P_DP, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_DC, P_EE, P_EE, P_EE, P_EE, P_EE, P_DC, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
-    { P_EO, P_EO, P_DR, P_DN, P_DB, P_DA, P_DG, P_DA, P_DB, P_DN, P_DR, P_EO, P_EO },
-    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
-    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
-};
-
-// move node, reprensent a move.
-struct MoveNode{
-    int32_t beginRow;
-    int32_t beginCol;
-    int32_t endRow;
-    int32_t endCol;
-
-    MoveNode()
-        : beginRow{ 0 }, beginCol{ 0 }, endRow{ 0 }, endCol{ 0 }
-    {}
-
-    MoveNode(int32_t beginRow, int32_t beginCol, int32_t endRow, int32_t endCol)
-        : beginRow{ beginRow }, beginCol{ beginCol }, endRow{ endRow }, endCol{ endCol }
-    {}
-
-    bool operator==(const MoveNode& other) const noexcept {
-        return beginRow == other.beginRow &&
-                beginCol == other.beginCol &&
-                endRow == other.endRow &&
-                endCol == other.endCol;
-    }
-
-    bool operator!=(const MoveNode& other) const noexcept {
-        return !(*this == other);
-    }
-};
-
-// history node, used for undo the previous move.
-struct HistoryNode{
-    MoveNode move;
-    Piece beginPiece;
-    Piece endPiece;
-
-    HistoryNode(const MoveNode& moveNode, Piece beginPiece, Piece endPiece)
-        : move{ moveNode }, beginPiece{ beginPiece }, endPiece{ endPiece }
-    {}
-};
+// the piece of the given side and type, side must be PS_UP or PS_DOWN, type must not be PT_EMPTY or PT_OUT.
+constexpr Piece piece_make(PieceSide side, PieceType type){
+    return static_cast<Piece>(side == PS_UP ? P_UP + type : P_DP + type);
+}
 
-// chess board.
-class ChessBoard{
-    std::array<std::array<Piece, BOARD_ACTUAL_COL_LEN>, BOARD_ACTUAL_ROW_LEN> data;
-    std::deque<HistoryNode> history;
-public:
-    ChessBoard(){
-        clear();
-    }
+// one step forward of a pawn of this side, side must be PS_UP or PS_DOWN.
+constexpr int32_t side_get_forward_offset(PieceSide side){
+    return side == PS_UP ? SQUARE_DOWN_OFFSET : SQUARE_UP_OFFSET;
+}
 
-    Piece get(int32_t r, int32_t c) const noexcept {
-        return data[r][c];
-    }
+/*
+    zobrist keys, used for hashing a chess board into a 64 bits integer.
+    the keys are generated from a fixed seed, so the same board always gets the same key,
+    empty and out of board pieces have zero keys, which makes the xor updating simple.
+*/
+struct ZobristKeys{
+    uint64_t pieceKeys[PIECE_TOTAL_LEN][BOARD_SQUARE_LEN];
+    uint64_t sideKey;
 
-    void set(int32_t r, int32_t c, Piece p) noexcept {
-        data[r][c] = p;
-    }
+    ZobristKeys(){
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
 
-    void clear() noexcept {
-        for (int32_t r = 0; r < BOARD_ACTUAL_ROW_LEN; ++r) {
-            for (int32_t c = 0; c < BOARD_ACTUAL_COL_LEN; ++c) {
-                data[r][c] = DEFAULT_CHESS_BOARD_DATA[r][c]; 
+        for (int32_t p = 0; p < PIECE_TOTAL_LEN; ++p){
+            for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+                pieceKeys[p][sq] = (p == P_EE || p == P_EO) ? 0 : next_random(seed);
             }
         }
 
-        history.clear();
-    }
-
-    void move(const MoveNode& moveNode){
-        Piece beginPiece = get(moveNode.beginRow, moveNode.beginCol);
-        Piece endPiece = get(moveNode.endRow, moveNode.endCol);
-
-        // record the history.
-        history.emplace_back(moveNode, beginPiece, endPiece);
-
-        // move the pieces.
-        set(moveNode.beginRow, moveNode.beginCol, P_EE);
-        set(moveNode.endRow, moveNode.endCol, beginPiece);
+        sideKey = next_random(seed);
     }
 
-    void undo(){
-        if (!history.empty()){   // if history is not empty, reset pieces and pop back.
-            const HistoryNode& node = history.back();
-
-            set(node.move.beginRow, node.move.beginCol, node.beginPiece);
-            set(node.move.endRow, node.move.endCol, node.endPiece);
-
-            history.pop_back();
-        }
+    // splitmix64.
+    static uint64_t next_random(uint64_t& seed){
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
     }
 };
 
-using PossibleMoves = std::vector<MoveNode>;
+const ZobristKeys zobristKeys;
 
-void check_possible_move_and_insert(const ChessBoard& cb, PossibleMoves& pm, int32_t beginRow, int32_t beginCol, int32_t endRow, int32_t endCol){
-    Piece beginP = cb.get(beginRow, beginCol);
-    Piece endP = cb.get(endRow, endCol);
-
-    if (endP != P_EO && piece_get_side(beginP) != piece_get_side(endP)){   // not out of chess board, and not the same side.
-        pm.emplace_back(beginRow, beginCol, endRow, endCol);
-    }
+inline uint64_t zobrist_get_piece_key(Piece p, int32_t sq){
+    return zobristKeys.pieceKeys[p][sq];
 }
 
-void gen_moves_pawn(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    if (side == PS_UP){
-        check_possible_move_and_insert(cb, pm,  r, c, r + 1, c);
-
-        if (r > BOARD_RIVER_UP){    // cross the river ?
-            check_possible_move_and_insert(cb, pm, r, c, r, c - 1);
-            check_possible_move_and_insert(cb, pm, r, c, r, c + 1);
-        }
-    }
-    else if (side == PS_DOWN){
-        check_possible_move_and_insert(cb, pm, r, c, r - 1, c);
-
-        if (r < BOARD_RIVER_DOWN){
-            check_possible_move_and_insert(cb, pm, r, c, r, c - 1);
-            check_possible_move_and_insert(cb, pm, r, c, r, c + 1);
-        }
-    }
+// the board key doesn't contain the side to move, xor this to get a key of (board, side).
+inline uint64_t zobrist_get_side_key(PieceSide side){
+    return side == PS_UP ? zobristKeys.sideKey : 0;
 }
 
-void gen_moves_cannon_one_direction(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, int32_t rGap, int32_t cGap, PieceSide side){
-    int32_t row, col;
-    Piece p;
-
-    for (row = r + rGap, col = c + cGap; ;row += rGap, col += cGap){
-        p = cb.get(row, col);
-
-        if (p == P_EE){    // empty piece, then insert it.
-            pm.emplace_back(r, c, row, col);
-        }
-        else {   // upper piece, down piece or out of chess board, break immediately.
-            break;
-        }
-    }
-
-    if (p != P_EO){   // not out of chess board, check if we can add an enemy piece.
-        for (row = row + rGap, col = col + cGap; ;row += rGap, col += cGap){
-            p = cb.get(row, col);
-        
-            if (p == P_EE){    // empty, then continue search.
-                continue;
-            }
-            else if (piece_get_side(p) == piece_side_get_reverse(side)){   // enemy piece, then insert it and break.
-                pm.emplace_back(r, c, row, col);
-                break;
-            }
-            else {    // self side piece or out of chess board, break.
-                break;
+/*
+    piece value plus position value of every piece on every square, so a piece's
+    contribution to the board score is one lookup. empty and out of board pieces are zero.
+*/
+struct PieceSquareValues{
+    int32_t values[PIECE_TOTAL_LEN][BOARD_SQUARE_LEN];
+
+    PieceSquareValues(){
+        for (int32_t p = 0; p < PIECE_TOTAL_LEN; ++p){
+            for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+                int32_t r = square_get_row(sq);
+                int32_t c = square_get_col(sq);
+
+                values[p][sq] = 0;
+                if (p != P_EE && p != P_EO && square_is_on_board(sq)){
+                    Piece piece = static_cast<Piece>(p);
+                    values[p][sq] = piece_get_value(piece) + piece_get_pos_value(piece, r - BOARD_ACTUAL_ROW_BEGIN, c - BOARD_ACTUAL_COL_BEGIN);
+                }
             }
         }
     }
+};
+
+const PieceSquareValues pieceSquareValues;
+
+inline int32_t piece_get_square_value(Piece p, int32_t sq){
+    return pieceSquareValues.values[p][sq];
 }
 
-void gen_moves_cannon(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    // go up, down, left, right.
-    gen_moves_cannon_one_direction(cb, pm, r, c, -1, 0, side);
-    gen_moves_cannon_one_direction(cb, pm, r, c, +1, 0, side);
-    gen_moves_cannon_one_direction(cb, pm, r, c, 0, -1, side);
-    gen_moves_cannon_one_direction(cb, pm, r, c, 0, +1, side);
+inline int32_t bit_scan_forward(uint64_t bits){
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int32_t>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
 }
 
-void gen_moves_rook_one_direction(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, int32_t rGap, int32_t cGap, PieceSide side){
-    int32_t row, col;
-    Piece p;
+// a set of squares of the 90 playable squares, see BOARD_INDEX_LEN.
+struct Bitboard{
+    uint64_t words[2];
 
-    for (row = r + rGap, col = c + cGap; ;row += rGap, col += cGap){
-        p = cb.get(row, col);
+    Bitboard()
+        : words{ 0, 0 }
+    {}
 
-        if (p == P_EE){    // empty piece, then insert it.
-            pm.emplace_back(r, c, row, col);
-        }
-        else {   // upper piece, down piece or out of chess board, break immediately.
-            break;
-        }
-    }
+    Bitboard(uint64_t lo, uint64_t hi)
+        : words{ lo, hi }
+    {}
 
-    if (piece_get_side(p) == piece_side_get_reverse(side)){   // enemy piece, then insert it.
-        pm.emplace_back(r, c, row, col);
+    bool test(int32_t index) const noexcept {
+        return (words[index >> 6] >> (index & 63)) & 1;
     }
-}
 
-void gen_moves_rook(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    // go up, down, left, right.
-    gen_moves_rook_one_direction(cb, pm, r, c, -1, 0, side);
-    gen_moves_rook_one_direction(cb, pm, r, c, +1, 0, side);
-    gen_moves_rook_one_direction(cb, pm, r, c, 0, -1, side);
-    gen_moves_rook_one_direction(cb, pm, r, c, 0, +1, side);
-}
+    void toggle(int32_t index) noexcept {
+        words[index >> 6] ^= uint64_t(1) << (index & 63);
+    }
 
-void gen_moves_knight(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    Piece p;
-    if ((p = cb.get(r + 1, c)) == P_EE){    // if not lame horse leg ?
-        check_possible_move_and_insert(cb, pm, r, c, r + 2, c + 1);
-        check_possible_move_and_insert(cb, pm, r, c, r + 2, c - 1);
+    Bitboard operator&(const Bitboard& other) const noexcept {
+        return Bitboard(words[0] & other.words[0], words[1] & other.words[1]);
     }
 
-    if ((p = cb.get(r - 1, c)) == P_EE){
-        check_possible_move_and_insert(cb, pm, r, c, r - 2, c + 1);
-        check_possible_move_and_insert(cb, pm, r, c, r - 2, c - 1);
+    Bitboard operator|(const Bitboard& other) const noexcept {
+        return Bitboard(words[0] | other.words[0], words[1] | other.words[1]);
     }
 
-    if ((p = cb.get(r, c + 1)) == P_EE){
-        check_possible_move_and_insert(cb, pm, r, c, r + 1, c + 2);
-        check_possible_move_and_insert(cb, pm, r, c, r - 1, c + 2);
+    Bitboard operator~() const noexcept {
+        return Bitboard(~words[0], ~words[1]);
     }
 
-    if ((p = cb.get(r, c - 1)) == P_EE){
-        check_possible_move_and_insert(cb, pm, r, c, r + 1, c - 2);
-        check_possible_move_and_insert(cb, pm, r, c, r - 1, c - 2);
+    bool operator==(const Bitboard& other) const noexcept {
+        return words[0] == other.words[0] && words[1] == other.words[1];
     }
-}
 
-void gen_moves_bishop(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    Piece p;
-    if (side == PS_UP){
-        if (r + 2 <= BOARD_RIVER_UP){       // bishop can't cross river.
-            if ((p = cb.get(r + 1, c + 1)) == P_EE){    // bishop can move only if Xiang Yan is empty.
-                check_possible_move_and_insert(cb, pm, r, c, r + 2, c + 2);
-            }
+    bool operator!=(const Bitboard& other) const noexcept {
+        return !(*this == other);
+    }
+};
 
-            if ((p = cb.get(r + 1, c - 1)) == P_EE){
-                check_possible_move_and_insert(cb, pm, r, c, r + 2, c - 2);
+/*
+    precomputed tables of the bitboard move generator.
+    a knight leg or a bishop eye out of chess board points to the piece itself, its targets are out of chess board too.
+    rooks and cannons look up the occupancy of their rank or file, the squares at both ends never stop a slide,
+    so they are left out of the index, which keeps the tables small enough for the L1 cache.
+*/
+struct BitboardTables{
+    int8_t squareIndex[BOARD_SQUARE_LEN];          // -1 if out of chess board.
+    uint8_t indexSquare[BOARD_INDEX_LEN];
+    Bitboard sideHalves[2];                        // bishops can't cross the river.
+    Bitboard pawnAttacks[2][BOARD_INDEX_LEN];
+    Bitboard advisorAttacks[2][BOARD_INDEX_LEN];
+    Bitboard generalAttacks[2][BOARD_INDEX_LEN];
+    uint8_t knightLegs[BOARD_INDEX_LEN][4];
+    Bitboard knightAttacks[BOARD_INDEX_LEN][4];    // the 2 targets behind every leg.
+    uint8_t bishopEyes[BOARD_INDEX_LEN][4];
+    Bitboard bishopAttacks[BOARD_INDEX_LEN][4];    // the target behind every eye.
+
+    // low 16 bits: empty squares and the first piece of both directions, high 16 bits: the first piece behind the screen.
+    uint32_t rankLines[BOARD_COL_LEN][1 << (BOARD_COL_LEN - 2)];
+    uint32_t fileLines[BOARD_ROW_LEN][1 << (BOARD_ROW_LEN - 2)];
+
+    BitboardTables(){
+        for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+            squareIndex[sq] = -1;
+
+            if (square_is_on_board(sq)){
+                int32_t index = (square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN) * BOARD_COL_LEN + square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;
+                squareIndex[sq] = static_cast<int8_t>(index);
+                indexSquare[index] = static_cast<uint8_t>(sq);
             }
         }
 
-        if ((p = cb.get(r - 1, c + 1)) == P_EE){
-            check_possible_move_and_insert(cb, pm, r, c, r - 2, c + 2);
-        }
+        for (int32_t index = 0; index < BOARD_INDEX_LEN; ++index){
+            int32_t r = square_get_row(indexSquare[index]);
+            add_target(r <= BOARD_RIVER_UP ? sideHalves[PS_UP] : sideHalves[PS_DOWN], indexSquare[index]);
 
-        if ((p = cb.get(r - 1, c - 1)) == P_EE){
-            check_possible_move_and_insert(cb, pm, r, c, r - 2, c - 2);
+            init_steppers(index);
         }
-    }
-    else if (side == PS_DOWN){
-        if (r - 2 >= BOARD_RIVER_DOWN){
-            if ((p = cb.get(r - 1, c + 1)) == P_EE){
-                check_possible_move_and_insert(cb, pm, r, c, r - 2, c + 2);
-            }
 
-            if ((p = cb.get(r - 1, c - 1)) == P_EE){
-                check_possible_move_and_insert(cb, pm, r, c, r - 2, c - 2);
+        for (int32_t pos = 0; pos < BOARD_COL_LEN; ++pos){
+            for (int32_t occ = 0; occ < (1 << (BOARD_COL_LEN - 2)); ++occ){
+                rankLines[pos][occ] = init_line(pos, occ << 1, BOARD_COL_LEN);
             }
         }
 
-        if ((p = cb.get(r + 1, c + 1)) == P_EE){
-            check_possible_move_and_insert(cb, pm, r, c, r + 2, c + 2);
-        }
-
-        if ((p = cb.get(r + 1, c - 1)) == P_EE){
-            check_possible_move_and_insert(cb, pm, r, c, r + 2, c - 2);
+        for (int32_t pos = 0; pos < BOARD_ROW_LEN; ++pos){
+            for (int32_t occ = 0; occ < (1 << (BOARD_ROW_LEN - 2)); ++occ){
+                fileLines[pos][occ] = init_line(pos, occ << 1, BOARD_ROW_LEN);
+            }
         }
     }
-}
-
-void gen_moves_advisor(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    if (side == PS_UP){
-        if (r + 1 <= BOARD_9_PALACE_UP_BOTTOM && c + 1 <= BOARD_9_PALACE_UP_RIGHT) {   // walk diagonal lines.
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c + 1);
-        }
 
-        if (r + 1 <= BOARD_9_PALACE_UP_BOTTOM && c - 1 >= BOARD_9_PALACE_UP_LEFT) {
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c - 1);
-        }
-
-        if (r - 1 >= BOARD_9_PALACE_UP_TOP && c + 1 <= BOARD_9_PALACE_UP_RIGHT) {
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c + 1);
+    void add_target(Bitboard& bb, int32_t target) const {
+        if (square_is_on_board(target) && !bb.test(squareIndex[target])){
+            bb.toggle(squareIndex[target]);
         }
+    }
 
-        if (r - 1 >= BOARD_9_PALACE_UP_TOP && c - 1 >= BOARD_9_PALACE_UP_LEFT) {
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c - 1);
-        }
+    // a leg or an eye, out of chess board ones are replaced by the piece itself.
+    uint8_t blocker_index(int32_t sq, int32_t blocker) const {
+        return static_cast<uint8_t>(squareIndex[square_is_on_board(blocker) ? blocker : sq]);
     }
-    else if (side == PS_DOWN){
-        if (r + 1 <= BOARD_9_PALACE_DOWN_BOTTOM && c + 1 <= BOARD_9_PALACE_DOWN_RIGHT) {
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c + 1);
-        }
 
-        if (r + 1 <= BOARD_9_PALACE_DOWN_BOTTOM && c - 1 >= BOARD_9_PALACE_DOWN_LEFT) {
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c - 1);
+    // the same rules as the mailbox generators.
+    void init_steppers(int32_t index){
+        constexpr int32_t KNIGHT_LEGS[4] = { SQUARE_DOWN_OFFSET, SQUARE_UP_OFFSET, SQUARE_RIGHT_OFFSET, SQUARE_LEFT_OFFSET };
+        constexpr int32_t BISHOP_EYES[4] = { SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET, SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET,
+                                             SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET, SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET };
+
+        int32_t sq = indexSquare[index];
+        int32_t r = square_get_row(sq);
+        int32_t c = square_get_col(sq);
+
+        // pawns.
+        add_target(pawnAttacks[PS_UP][index], sq + SQUARE_DOWN_OFFSET);
+        if (r > BOARD_RIVER_UP){
+            add_target(pawnAttacks[PS_UP][index], sq + SQUARE_LEFT_OFFSET);
+            add_target(pawnAttacks[PS_UP][index], sq + SQUARE_RIGHT_OFFSET);
         }
 
-        if (r - 1 >= BOARD_9_PALACE_DOWN_TOP && c + 1 <= BOARD_9_PALACE_DOWN_RIGHT) {
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c + 1);
+        add_target(pawnAttacks[PS_DOWN][index], sq + SQUARE_UP_OFFSET);
+        if (r < BOARD_RIVER_DOWN){
+            add_target(pawnAttacks[PS_DOWN][index], sq + SQUARE_LEFT_OFFSET);
+            add_target(pawnAttacks[PS_DOWN][index], sq + SQUARE_RIGHT_OFFSET);
         }
 
-        if (r - 1 >= BOARD_9_PALACE_DOWN_TOP && c - 1 >= BOARD_9_PALACE_DOWN_LEFT) {
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c - 1);
+        // advisors and generals stay in their 9 palaces.
+        const int32_t palaceTop[2]    = { BOARD_9_PALACE_UP_TOP, BOARD_9_PALACE_DOWN_TOP };
+        const int32_t palaceBottom[2] = { BOARD_9_PALACE_UP_BOTTOM, BOARD_9_PALACE_DOWN_BOTTOM };
+        const int32_t palaceLeft[2]   = { BOARD_9_PALACE_UP_LEFT, BOARD_9_PALACE_DOWN_LEFT };
+        const int32_t palaceRight[2]  = { BOARD_9_PALACE_UP_RIGHT, BOARD_9_PALACE_DOWN_RIGHT };
+
+        for (int32_t side = PS_UP; side <= PS_DOWN; ++side){
+            bool down  = r + 1 <= palaceBottom[side];
+            bool up    = r - 1 >= palaceTop[side];
+            bool right = c + 1 <= palaceRight[side];
+            bool left  = c - 1 >= palaceLeft[side];
+
+            if (down && right) add_target(advisorAttacks[side][index], sq + SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET);
+            if (down && left)  add_target(advisorAttacks[side][index], sq + SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET);
+            if (up && right)   add_target(advisorAttacks[side][index], sq + SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET);
+            if (up && left)    add_target(advisorAttacks[side][index], sq + SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET);
+
+            if (down)  add_target(generalAttacks[side][index], sq + SQUARE_DOWN_OFFSET);
+            if (up)    add_target(generalAttacks[side][index], sq + SQUARE_UP_OFFSET);
+            if (right) add_target(generalAttacks[side][index], sq + SQUARE_RIGHT_OFFSET);
+            if (left)  add_target(generalAttacks[side][index], sq + SQUARE_LEFT_OFFSET);
         }
-    }
-}
-
-void gen_moves_general(const ChessBoard& cb, PossibleMoves& pm, int32_t r, int32_t c, PieceSide side){
-    Piece p;
-    int32_t row;
 
-    if (side == PS_UP){
-        if (r + 1 <= BOARD_9_PALACE_UP_BOTTOM){   // walk horizontal or vertical.
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c);
-        }
+        // knights and bishops.
+        for (int32_t i = 0; i < 4; ++i){
+            int32_t leg = KNIGHT_LEGS[i];
+            int32_t turn = (i < 2) ? SQUARE_RIGHT_OFFSET : SQUARE_DOWN_OFFSET;
 
-        if (r - 1 >= BOARD_9_PALACE_UP_TOP){
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c);
-        }
+            knightLegs[index][i] = blocker_index(sq, sq + leg);
+            add_target(knightAttacks[index][i], sq + 2 * leg + turn);
+            add_target(knightAttacks[index][i], sq + 2 * leg - turn);
 
-        if (c + 1 <= BOARD_9_PALACE_UP_RIGHT){
-            check_possible_move_and_insert(cb, pm, r, c, r, c + 1);
+            bishopEyes[index][i] = blocker_index(sq, sq + BISHOP_EYES[i]);
+            add_target(bishopAttacks[index][i], sq + 2 * BISHOP_EYES[i]);
         }
+    }
 
-        if (c - 1 >= BOARD_9_PALACE_UP_LEFT){
-            check_possible_move_and_insert(cb, pm, r, c, r, c - 1);
-        }
+    // a rook or cannon at pos of a line with len squares, occ is the occupancy of the line.
+    uint32_t init_line(int32_t pos, int32_t occ, int32_t len){
+        uint32_t slides = 0;
+        uint32_t cannonJumps = 0;
 
-        // check if both generals faced each other directly.
-        for (row = r + 1; row <= BOARD_ACTUAL_ROW_END ;++row){
-            p = cb.get(row, c);
+        for (int32_t step = -1; step <= 1; step += 2){
+            int32_t i = pos + step;
 
-            if (p == P_EE){
-                continue;
-            }
-            else if (p == P_DG){
-                pm.emplace_back(r, c, row, c);
-                break;
+            for (; i >= 0 && i < len; i += step){
+                slides |= 1 << i;
+                if (occ & (1 << i)){
+                    break;
+                }
             }
-            else {
-                break;
+
+            for (i += step; i >= 0 && i < len; i += step){
+                if (occ & (1 << i) || i == 0 || i == len - 1){
+                    cannonJumps |= 1 << i;
+                    break;
+                }
             }
         }
+
+        return slides | (cannonJumps << 16);
     }
-    else if (side == PS_DOWN){
-        if (r + 1 <= BOARD_9_PALACE_DOWN_BOTTOM){
-            check_possible_move_and_insert(cb, pm, r, c, r + 1, c);
-        }
+};
 
-        if (r - 1 >= BOARD_9_PALACE_DOWN_TOP){
-            check_possible_move_and_insert(cb, pm, r, c, r - 1, c);
-        }
+const BitboardTables bitboardTables;
 
-        if (c + 1 <= BOARD_9_PALACE_DOWN_RIGHT){
-            check_possible_move_and_insert(cb, pm, r, c, r, c + 1);
-        }
+// see BitboardTables::rankLines, occ is the full occupancy of the rank.
+inline uint32_t bitboard_get_rank_line(int32_t c, uint32_t occ){
+    return bitboardTables.rankLines[c][(occ >> 1) & ((1 << (BOARD_COL_LEN - 2)) - 1)];
+}
 
-        if (c - 1 >= BOARD_9_PALACE_DOWN_LEFT){
-            check_possible_move_and_insert(cb, pm, r, c, r, c - 1);
-        }
+inline uint32_t bitboard_get_file_line(int32_t r, uint32_t occ){
+    return bitboardTables.fileLines[r][(occ >> 1) & ((1 << (BOARD_ROW_LEN - 2)) - 1)];
+}
 
-        for (row = r - 1; row >= BOARD_ACTUAL_ROW_BEGIN ;--row){
-            p = cb.get(row, c);
+inline int32_t square_get_index(int32_t sq){
+    return bitboardTables.squareIndex[sq];
+}
 
-            if (p == P_EE){
-                continue;
-            }
-            else if (p == P_UG){
-                pm.emplace_back(r, c, row, c);
-                break;
-            }
-            else {
-                break;
-            }
-        }
-    }
+inline int32_t index_get_square(int32_t index){
+    return bitboardTables.indexSquare[index];
 }
 
 /* 
-    generate possible moves for one side. 
-    you should call free() on the returned value later.
+    a default chess board, used as a template for new board.
+    P_EO is used here for speeding up rules checking.
 */
-PossibleMoves gen_possible_moves(const ChessBoard& cb, PieceSide side){
-    PossibleMoves pm;
-    pm.reserve(MAX_ONE_SIDE_POSSIBLE_MOVES_LEN);
-
-    Piece p;
-    for (int32_t r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r) {
-        for (int32_t c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c){
-            p = cb.get(r, c);
-
-            if (piece_get_side(p) == side){
-                switch (piece_get_type(p))
-                {
-                case PT_PAWN:
-                    gen_moves_pawn(cb, pm, r, c, side);
-                    break;
-                case PT_CANNON:
-                    gen_moves_cannon(cb, pm, r, c, side);
-                    break;
-                case PT_ROOK:
-                    gen_moves_rook(cb, pm, r, c, side);
-                    break;
-                case PT_KNIGHT:
-                    gen_moves_knight(cb, pm, r, c, side);
-                    break;
-                case PT_BISHOP:
-                    gen_moves_bishop(cb, pm, r, c, side);
-                    break;
-                case PT_ADVISOR:
-                    gen_moves_advisor(cb, pm, r, c, side);
-                    break;
-                case PT_GENERAL:
-                    gen_moves_general(cb, pm, r, c, side);
-                    break;
-                case PT_EMPTY:
-                case PT_OUT:
-                default:
-                    break;
-                }
-            }
-        }
+constexpr Piece DEFAULT_CHESS_BOARD_DATA[BOARD_ACTUAL_ROW_LEN][BOARD_ACTUAL_COL_LEN] = {
+    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
+    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
+    { P_EO, P_EO, P_UR, P_UN, P_UB, P_UA, P_UG, P_UA, P_UB, P_UN, P_UR, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_UC, P_EE, P_EE, P_EE, P_EE, P_EE, P_UC, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_UP, P_EE, P_UP, P_EE, P_UP, P_EE, P_UP, P_EE, P_UP, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_DP, P_EE, P_DP, P_EE, P_DP, P_EE, P_DP, P_EE, P_DP, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_DC, P_EE, P_EE, P_EE, P_EE, P_EE, P_DC, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EE, P_EO, P_EO },
+    { P_EO, P_EO, P_DR, P_DN, P_DB, P_DA, P_DG, P_DA, P_DB, P_DN, P_DR, P_EO, P_EO },
+    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
+    { P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO, P_EO },
+};
+
+/*
+    xiangqi FEN of the default chess board. FEN lists the ranks from the upper side to the down side,
+    red(uppercase, moves first) is the down side and black(lowercase) is the upper side,
+    so the letters are the other way round from pieceCharMapping.
+*/
+constexpr const char* START_FEN = "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR w - - 0 1";
+
+// max length of a FEN written by ChessBoard::get_fen(), including the terminating null.
+constexpr size_t FEN_MAX_LEN = 128;
+
+constexpr char pieceFenCharMapping[] = {
+    'p', 'c', 'r', 'n', 'b', 'a', 'k',     /* upper pieces, black. */
+    'P', 'C', 'R', 'N', 'B', 'A', 'K',     /* down pieces, red. */
+};
+
+// max number of pieces of every type of one side, by PieceType.
+constexpr int32_t pieceTypeMaxCountMapping[] = { 5, 2, 2, 2, 2, 2, 1 };
+
+constexpr char piece_get_fen_char(Piece p){
+    return pieceFenCharMapping[p];
+}
+
+// the piece of a FEN char, 'e' and 'h' are accepted for bishop and knight too, P_EO if it is not a piece.
+inline Piece piece_from_fen_char(char ch){
+    PieceSide side = (ch >= 'A' && ch <= 'Z') ? PS_DOWN : PS_UP;
+
+    switch (ch | 0x20){     // to lowercase.
+    case 'p': return piece_make(side, PT_PAWN);
+    case 'c': return piece_make(side, PT_CANNON);
+    case 'r': return piece_make(side, PT_ROOK);
+    case 'n': case 'h': return piece_make(side, PT_KNIGHT);
+    case 'b': case 'e': return piece_make(side, PT_BISHOP);
+    case 'a': return piece_make(side, PT_ADVISOR);
+    case 'k': return piece_make(side, PT_GENERAL);
+    default: return P_EO;
     }
+}
 
-    return pm;
+// if piece p can stand on the square, generals and advisors stay in their palace, bishops don't cross the river.
+inline bool piece_can_stand_on(Piece p, int32_t sq){
+    int32_t r = square_get_row(sq);
+    int32_t c = square_get_col(sq);
+    bool up = piece_get_side(p) == PS_UP;
+
+    switch (piece_get_type(p)){
+    case PT_GENERAL:
+    case PT_ADVISOR:
+        return up ? (r >= BOARD_9_PALACE_UP_TOP && r <= BOARD_9_PALACE_UP_BOTTOM && c >= BOARD_9_PALACE_UP_LEFT && c <= BOARD_9_PALACE_UP_RIGHT)
+                  : (r >= BOARD_9_PALACE_DOWN_TOP && r <= BOARD_9_PALACE_DOWN_BOTTOM && c >= BOARD_9_PALACE_DOWN_LEFT && c <= BOARD_9_PALACE_DOWN_RIGHT);
+    case PT_BISHOP:
+        return up ? r <= BOARD_RIVER_UP : r >= BOARD_RIVER_DOWN;
+    default:
+        return true;
+    }
 }
 
-/* 
-    calculate a chess board's score. 
-    upper side value is negative, down side is positive.
+/*
+    move node, reprensent a move, packed into 16 bits:
+    the low 8 bits is the begin square, the high 8 bits is the end square.
+    a zero move(square 0 is out of chess board) means no move.
 */
-int32_t board_calc_score(const ChessBoard& cb){
-    int32_t totalScore = 0;
+struct MoveNode{
+    uint16_t value;
 
-    Piece p;
-    for (int32_t r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r) {
-        for (int32_t c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c){
-            p = cb.get(r, c);
+    MoveNode()
+        : value{ 0 }
+    {}
+
+    MoveNode(int32_t beginSquare, int32_t endSquare)
+        : value{ static_cast<uint16_t>(beginSquare | (endSquare << 8)) }
+    {}
+
+    int32_t begin() const noexcept {
+        return value & 0xFF;
+    }
+
+    int32_t end() const noexcept {
+        return value >> 8;
+    }
+
+    int32_t begin_row() const noexcept {
+        return square_get_row(begin());
+    }
+
+    int32_t begin_col() const noexcept {
+        return square_get_col(begin());
+    }
+
+    int32_t end_row() const noexcept {
+        return square_get_row(end());
+    }
+
+    int32_t end_col() const noexcept {
+        return square_get_col(end());
+    }
+
+    bool operator==(const MoveNode& other) const noexcept {
+        return value == other.value;
+    }
+
+    bool operator!=(const MoveNode& other) const noexcept {
+        return !(*this == other);
+    }
+};
+
+/*
+    history node, used for undo the previous move, the moved piece is still on the end square.
+    endPieceIndex is the captured piece's index in its piece list, so undo puts it back to exactly the same place.
+*/
+struct HistoryNode{
+    MoveNode move;              // a zero move is a null move, the side to move passed.
+    Piece endPiece;
+    uint8_t endPieceIndex;
+    uint16_t reversiblePlies;   // plies since the last capture, pawn advance or null move, this one included.
+    uint64_t key;               // key of the chess board before the move.
+
+    HistoryNode(const MoveNode& moveNode, Piece endPiece, uint8_t endPieceIndex, uint16_t reversiblePlies, uint64_t key)
+        : move{ moveNode }, endPiece{ endPiece }, endPieceIndex{ endPieceIndex }, reversiblePlies{ reversiblePlies }, key{ key }
+    {}
+};
+
+/*
+    chess board.
+    besides the mailbox, every kind of piece has a list of the squares it stands on,
+    so move generation and general lookup only visit the pieces, not the 90 squares.
+    pieceListIndex maps an occupied square to its index in the piece list.
+*/
+class ChessBoard{
+    std::array<Piece, BOARD_SQUARE_LEN> data;
+    std::array<std::array<uint8_t, MAX_ONE_KIND_PIECES_LEN>, P_EE> pieceSquares;
+    std::array<uint8_t, P_EE> pieceCounts;
+    std::array<uint8_t, BOARD_SQUARE_LEN> pieceListIndex;
+    std::array<Bitboard, 2> sideOccupancy;                                          // only with BITBOARD_MOVEGEN_ENABLED.
+    std::array<std::array<uint16_t, BOARD_ROW_LEN>, 2> rankOccupancy;               // only with BITBOARD_MOVEGEN_ENABLED.
+    std::array<std::array<uint16_t, BOARD_COL_LEN>, 2> fileOccupancy;               // only with BITBOARD_MOVEGEN_ENABLED.
+    std::vector<HistoryNode> history;
+    uint64_t key;     // zobrist key of current pieces, updated incrementally.
+    int32_t score;    // material and position score, updated incrementally, see board_calc_score().
+
+    void piece_list_add(Piece p, int32_t sq) noexcept {
+        pieceListIndex[sq] = pieceCounts[p];
+        pieceSquares[p][pieceCounts[p]++] = static_cast<uint8_t>(sq);
+    }
+
+    // remove by moving the last one into the hole, return the removed index for undo.
+    uint8_t piece_list_remove(Piece p, int32_t sq) noexcept {
+        uint8_t index = pieceListIndex[sq];
+        uint8_t last = pieceSquares[p][--pieceCounts[p]];
+
+        pieceSquares[p][index] = last;
+        pieceListIndex[last] = index;
+        return index;
+    }
+
+    // reverse of piece_list_remove(), the list order is restored exactly.
+    void piece_list_restore(Piece p, int32_t sq, uint8_t index) noexcept {
+        uint8_t last = pieceCounts[p]++;
+
+        if (index != last){
+            uint8_t moved = pieceSquares[p][index];
+            pieceSquares[p][last] = moved;
+            pieceListIndex[moved] = last;
+        }
+
+        pieceSquares[p][index] = static_cast<uint8_t>(sq);
+        pieceListIndex[sq] = index;
+    }
+
+    // add or remove a piece of this side to the occupancy bitboards.
+    void occupancy_toggle(PieceSide side, int32_t sq) noexcept {
+        int32_t r = square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN;
+        int32_t c = square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;
+
+        sideOccupancy[side].toggle(square_get_index(sq));
+        rankOccupancy[side][r] ^= 1 << c;
+        fileOccupancy[side][c] ^= 1 << r;
+    }
+
+    void occupancy_move(const MoveNode& moveNode, Piece beginPiece, Piece endPiece) noexcept {
+        occupancy_toggle(piece_get_side(beginPiece), moveNode.begin());
+        occupancy_toggle(piece_get_side(beginPiece), moveNode.end());
+
+        if (endPiece != P_EE){
+            occupancy_toggle(piece_get_side(endPiece), moveNode.end());
+        }
+    }
+
+    void piece_list_move(int32_t beginSquare, int32_t endSquare) noexcept {
+        uint8_t index = pieceListIndex[beginSquare];
+
+        pieceSquares[data[beginSquare]][index] = static_cast<uint8_t>(endSquare);
+        pieceListIndex[endSquare] = index;
+    }
 
-            if (p != P_EE){
-                totalScore += piece_get_value(p);
-                totalScore += piece_get_pos_value(p, r - BOARD_ACTUAL_ROW_BEGIN, c - BOARD_ACTUAL_COL_BEGIN);
+    // recompute the incremental states from scratch, and abort if they are different.
+    void debug_check_incremental_states() const {
+        uint64_t fullKey = 0;
+        int32_t fullScore = 0;
+        std::array<uint8_t, P_EE> fullCounts{};
+        std::array<Bitboard, 2> fullOccupancy;
+
+        for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+            Piece p = data[sq];
+
+            fullKey ^= zobrist_get_piece_key(p, sq);
+            fullScore += piece_get_square_value(p, sq);
+
+            if (p != P_EE && p != P_EO){
+                ++fullCounts[p];
+                fullOccupancy[piece_get_side(p)].toggle(square_get_index(sq));
+
+                if (pieceListIndex[sq] >= pieceCounts[p] || pieceSquares[p][pieceListIndex[sq]] != sq){
+                    std::cerr << "debug check failed: square " << sq << " is not in the piece list of '" << piece_get_char(p) << "'.\n";
+                    std::abort();
+                }
             }
         }
+
+        if (fullKey != key || fullScore != score || fullCounts != pieceCounts){
+            std::cerr << "debug check failed: incremental key " << key << " score " << score
+                      << ", full recomputation key " << fullKey << " score " << fullScore << ".\n";
+            std::abort();
+        }
+
+        if (BITBOARD_MOVEGEN_ENABLED && fullOccupancy != sideOccupancy){
+            std::cerr << "debug check failed: occupancy bitboards are different from the mailbox.\n";
+            std::abort();
+        }
+    }
+public:
+    ChessBoard(){
+        history.reserve(HISTORY_PRE_ALLOC_CAPACITY);
+        clear();
     }
 
-    return totalScore;
-}
+    Piece get(int32_t sq) const noexcept {
+        return data[sq];
+    }
+
+    Piece get(int32_t r, int32_t c) const noexcept {
+        return data[square_make(r, c)];
+    }
 
-// min-max algorithm, with alpha-beta pruning.
-int32_t min_max(ChessBoard& cb, uint16_t searchDepth, int32_t alpha, int32_t beta, PieceSide side){
-    if (searchDepth == 0){
-        return board_calc_score(cb);
+    // raw change of one square, the piece lists and bitboards are not updated, call rebuild_states() after a batch of set().
+    void set(int32_t sq, Piece p) noexcept {
+        key ^= zobrist_get_piece_key(data[sq], sq) ^ zobrist_get_piece_key(p, sq);
+        score += piece_get_square_value(p, sq) - piece_get_square_value(data[sq], sq);
+        data[sq] = p;
     }
 
-    if (side == PS_UP){
-        int32_t minValue = std::numeric_limits<int32_t>::max();
-        PossibleMoves possibleMoves = gen_possible_moves(cb, PS_UP);
+    void set(int32_t r, int32_t c, Piece p) noexcept {
+        set(square_make(r, c), p);
+    }
 
-        for (const MoveNode& node : possibleMoves) {
-            cb.move(node);
-            minValue = std::min(minValue, min_max(cb, searchDepth - 1, alpha, beta, PS_DOWN));
-            cb.undo();
+    uint64_t get_key() const noexcept {
+        return key;
+    }
 
-            beta = std::min(beta, minValue);
-            if (alpha >= beta){
-                break;
+    int32_t get_score() const noexcept {
+        return score;
+    }
+
+    int32_t get_piece_count(Piece p) const noexcept {
+        return pieceCounts[p];
+    }
+
+    // squares of all the pieces p, from 0 to get_piece_count(p) - 1.
+    const uint8_t* get_piece_squares(Piece p) const noexcept {
+        return pieceSquares[p].data();
+    }
+
+    // square of the general of this side, 0 (out of chess board) if it has been captured.
+    int32_t get_general_square(PieceSide side) const noexcept {
+        Piece general = piece_make(side, PT_GENERAL);
+        return pieceCounts[general] > 0 ? pieceSquares[general][0] : 0;
+    }
+
+    const Bitboard& get_side_occupancy(PieceSide side) const noexcept {
+        return sideOccupancy[side];
+    }
+
+    // bit c is set if column c(from 0) of row r(from 0) has a piece of this side.
+    uint16_t get_rank_occupancy(PieceSide side, int32_t r) const noexcept {
+        return rankOccupancy[side][r];
+    }
+
+    // bit r is set if row r(from 0) of column c(from 0) has a piece of this side.
+    uint16_t get_file_occupancy(PieceSide side, int32_t c) const noexcept {
+        return fileOccupancy[side][c];
+    }
+
+    // recompute the key, the score, the piece lists and the occupancy bitboards from the mailbox.
+    void rebuild_states() noexcept {
+        key = 0;
+        score = 0;
+        pieceCounts.fill(0);
+        sideOccupancy.fill(Bitboard());
+        rankOccupancy[PS_UP].fill(0);
+        rankOccupancy[PS_DOWN].fill(0);
+        fileOccupancy[PS_UP].fill(0);
+        fileOccupancy[PS_DOWN].fill(0);
+
+        for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+            Piece p = data[sq];
+
+            key ^= zobrist_get_piece_key(p, sq);
+            score += piece_get_square_value(p, sq);
+
+            if (p != P_EE && p != P_EO){
+                piece_list_add(p, sq);
+                occupancy_toggle(piece_get_side(p), sq);
+            }
+        }
+    }
+
+    void clear() noexcept {
+        for (int32_t r = 0; r < BOARD_ACTUAL_ROW_LEN; ++r) {
+            for (int32_t c = 0; c < BOARD_ACTUAL_COL_LEN; ++c) {
+                data[square_make(r, c)] = DEFAULT_CHESS_BOARD_DATA[r][c]; 
             }
         }
 
-        return minValue;
+        rebuild_states();
+        history.clear();
     }
-    else if (side == PS_DOWN){
-        int32_t maxValue = std::numeric_limits<int32_t>::min();
-        PossibleMoves possibleMoves = gen_possible_moves(cb, PS_DOWN);
 
-        for (const MoveNode& node : possibleMoves) {
-            cb.move(node);
-            maxValue = std::max(maxValue, min_max(cb, searchDepth - 1, alpha, beta, PS_UP));
-            cb.undo();
+    /*
+        load a position from xiangqi FEN(see START_FEN), the history is cleared.
+        the side to move is 'w' or 'r' for the down side, 'b' for the upper side, it is the down side if missing,
+        the fields behind it are ignored. fen is read up to len chars and doesn't need to be null-terminated.
+        nothing is allocated, so millions of positions can be streamed through one board.
+        return false if fen is not a valid position, the board is unchanged then.
+    */
+    bool set_fen(const char* fen, size_t len, PieceSide& sideToMove) noexcept {
+        std::array<Piece, BOARD_INDEX_LEN> pieces;
+        std::array<int32_t, P_EE> counts{};
+        int32_t r = 0;
+        int32_t c = 0;
+        size_t i = 0;
+
+        for (; i < len && fen[i] != ' '; ++i){
+            char ch = fen[i];
+
+            if (ch == '/'){
+                if (c != BOARD_COL_LEN || ++r >= BOARD_ROW_LEN){
+                    return false;
+                }
+                c = 0;
+            }
+            else if (ch >= '1' && ch <= '9'){
+                if (c + (ch - '0') > BOARD_COL_LEN){
+                    return false;
+                }
+                for (int32_t n = ch - '0'; n > 0; --n){
+                    pieces[r * BOARD_COL_LEN + c++] = P_EE;
+                }
+            }
+            else {
+                Piece p = piece_from_fen_char(ch);
+                int32_t sq = square_make(r + BOARD_ACTUAL_ROW_BEGIN, c + BOARD_ACTUAL_COL_BEGIN);
 
-            alpha = std::max(alpha, maxValue);
-            if (alpha >= beta){
-                break;
+                if (p == P_EO || c >= BOARD_COL_LEN || !piece_can_stand_on(p, sq) ||
+                    ++counts[p] > pieceTypeMaxCountMapping[piece_get_type(p)]){
+                    return false;
+                }
+                pieces[r * BOARD_COL_LEN + c++] = p;
+            }
+        }
+
+        if (r != BOARD_ROW_LEN - 1 || c != BOARD_COL_LEN || counts[P_UG] != 1 || counts[P_DG] != 1){
+            return false;
+        }
+
+        while (i < len && fen[i] == ' '){
+            ++i;
+        }
+
+        PieceSide side = PS_DOWN;
+        if (i < len && fen[i] == 'b'){
+            side = PS_UP;
+        }
+        else if (i < len && fen[i] != 'w' && fen[i] != 'r'){
+            return false;
+        }
+
+        for (r = 0; r < BOARD_ROW_LEN; ++r){
+            for (c = 0; c < BOARD_COL_LEN; ++c){
+                data[square_make(r + BOARD_ACTUAL_ROW_BEGIN, c + BOARD_ACTUAL_COL_BEGIN)] = pieces[r * BOARD_COL_LEN + c];
             }
         }
 
-        return maxValue;
+        rebuild_states();
+        history.clear();
+        sideToMove = side;
+        return true;
     }
-    else {   // never need this, just for return value.
-        return 0;
+
+    bool set_fen(const std::string& fen, PieceSide& sideToMove) noexcept {
+        return set_fen(fen.data(), fen.size(), sideToMove);
     }
-}
 
-/* 
-    gen best move for one side. 
-    searchDepth is used as difficulty rank, the bigger it is, the more time the generation costs.
-    give param enum PieceSide: PS_EXTRA to this function is meaningless, you will always get a struct MoveNode object with {0, 0, 0, 0}.
-*/
-MoveNode gen_best_move(ChessBoard& cb, PieceSide side, uint16_t searchDepth){
-    int32_t value;
-    int32_t alpha = std::numeric_limits<int32_t>::min();
-    int32_t beta = std::numeric_limits<int32_t>::max();
+    /*
+        write the position as xiangqi FEN into buffer, which has FEN_MAX_LEN chars at least, return its length.
+        the move counters are always "0 1", the board doesn't know them. nothing is allocated.
+    */
+    size_t get_fen(PieceSide sideToMove, char* buffer) const noexcept {
+        size_t len = 0;
 
-    MoveNode bestMove;
+        for (int32_t r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r){
+            int32_t empty = 0;
 
-    if (side == PS_UP){
-        int32_t minValue = beta;
-        PossibleMoves possibleMoves = gen_possible_moves(cb, PS_UP);
+            for (int32_t c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c){
+                Piece p = get(r, c);
 
-        for (const MoveNode& node : possibleMoves){
-            cb.move(node);
-            value = min_max(cb, searchDepth, alpha, beta, PS_DOWN);
-            cb.undo();
+                if (p == P_EE){
+                    ++empty;
+                    continue;
+                }
+
+                if (empty > 0){
+                    buffer[len++] = static_cast<char>('0' + empty);
+                    empty = 0;
+                }
+                buffer[len++] = piece_get_fen_char(p);
+            }
 
-            if (value <= minValue){
-                minValue = value;
-                bestMove = node;
+            if (empty > 0){
+                buffer[len++] = static_cast<char>('0' + empty);
             }
+            if (r != BOARD_ACTUAL_ROW_END){
+                buffer[len++] = '/';
+            }
+        }
+
+        for (const char* tail = sideToMove == PS_UP ? " b - - 0 1" : " w - - 0 1"; *tail != '\0'; ++tail){
+            buffer[len++] = *tail;
         }
+
+        buffer[len] = '\0';
+        return len;
     }
-    else if (side == PS_DOWN){
-        int32_t maxValue = alpha;
-        PossibleMoves possibleMoves = gen_possible_moves(cb, PS_DOWN);
 
-        for (const MoveNode& node : possibleMoves){
-            cb.move(node);
-            value = min_max(cb, searchDepth, alpha, beta, PS_UP);
-            cb.undo();
+    std::string get_fen(PieceSide sideToMove) const {
+        char buffer[FEN_MAX_LEN];
+        size_t len = get_fen(sideToMove, buffer);
+        return std::string(buffer, len);
+    }
+
+    // plies since the last capture, pawn advance or null move, only they can repeat a position.
+    uint16_t get_reversible_plies() const noexcept {
+        return history.empty() ? 0 : history.back().reversiblePlies;
+    }
 
-            if (value >= maxValue){
-                maxValue = value;
-                bestMove = node;
+    /*
+        plies since the current position, with the same side to move, was on the chess board the last time,
+        0 if it wasn't since the last capture, pawn advance or null move. only every second ply is compared.
+    */
+    int32_t get_repetition_distance() const noexcept {
+        for (int32_t distance = 4, plies = get_reversible_plies(); distance <= plies; distance += 2){
+            if (history[history.size() - distance].key == key){
+                return distance;
             }
         }
+
+        return 0;
     }
-    
-    return bestMove;
-}
 
-// given move is fit for rule ? return false if not.
-bool check_rule(const ChessBoard& cb, const MoveNode& moveNode){
-    Piece p = cb.get(moveNode.beginRow, moveNode.beginCol);
-    PossibleMoves pm = gen_possible_moves(cb, piece_get_side(p));
+    // how many times the current position, with the same side to move, was on the chess board before.
+    int32_t get_repetition_count() const noexcept {
+        int32_t count = 0;
+        for (int32_t distance = 4, plies = get_reversible_plies(); distance <= plies; distance += 2){
+            count += history[history.size() - distance].key == key;
+        }
 
-    return std::find(pm.cbegin(), pm.cend(), moveNode) != pm.cend();
-}
+        return count;
+    }
 
-// user input could represent a move ? return false if can't.
-bool check_input_is_a_move(const std::string& input){
-    if (input.size() < 4){
-        return false;
+    // the last move, a zero move if there isn't one.
+    MoveNode get_last_move() const noexcept {
+        return history.empty() ? MoveNode{} : history.back().move;
     }
 
-    return  (input[0] >= 'a' && input[0] <= 'i') &&
-            (input[1] >= '0' && input[1] <= '9') &&
-            (input[2] >= 'a' && input[2] <= 'i') &&
-            (input[3] >= '0' && input[3] <= '9');
-}
+    void move(const MoveNode& moveNode){
+        Piece beginPiece = get(moveNode.begin());
+        Piece endPiece = get(moveNode.end());
+        uint8_t endPieceIndex = 0;
 
-/*
-    convert user input to a struct MoveNode object.
-    you should call check_input_is_a_move() before to make sure this converting is valid.
-*/
-MoveNode convert_input_to_move(const std::string& input){
-    MoveNode m;
+        // update the piece lists.
+        if (endPiece != P_EE){
+            endPieceIndex = piece_list_remove(endPiece, moveNode.end());
+        }
+        piece_list_move(moveNode.begin(), moveNode.end());
 
-    m.beginRow = 9 - (static_cast<int32_t>(input[1]) - static_cast<int32_t>('0')) + BOARD_ACTUAL_ROW_BEGIN;
-    m.beginCol = static_cast<int32_t>(input[0]) - static_cast<int32_t>('a') + BOARD_ACTUAL_COL_BEGIN;
-    m.endRow   = 9 - (static_cast<int32_t>(input[3]) - static_cast<int32_t>('0')) + BOARD_ACTUAL_ROW_BEGIN;
-    m.endCol   = static_cast<int32_t>(input[2]) - static_cast<int32_t>('a') + BOARD_ACTUAL_COL_BEGIN;
+        if (BITBOARD_MOVEGEN_ENABLED){
+            occupancy_move(moveNode, beginPiece, endPiece);
+        }
 
-    return m;
-}
+        // record the history, a capture or a pawn advance can't be undone by a move, so it ends every repetition.
+        bool reversible = endPiece == P_EE &&
+            (piece_get_type(beginPiece) != PT_PAWN || square_get_row(moveNode.begin()) == square_get_row(moveNode.end()));
+        uint16_t reversiblePlies = reversible ? static_cast<uint16_t>(get_reversible_plies() + 1) : 0;
+        history.emplace_back(moveNode, endPiece, endPieceIndex, reversiblePlies, key);
 
-// convert a move to string.
-std::string convert_move_to_str(const MoveNode& move){
-    std::string buf;
+        // move the pieces.
+        set(moveNode.begin(), P_EE);
+        set(moveNode.end(), beginPiece);
 
-    buf += static_cast<char>(move.beginCol - BOARD_ACTUAL_COL_BEGIN + 'a');
-    buf += static_cast<char>(9 - (move.beginRow - BOARD_ACTUAL_ROW_BEGIN) + '0');
-    buf += static_cast<char>(move.endCol - BOARD_ACTUAL_COL_BEGIN + 'a');
-    buf += static_cast<char>(9 - (move.endRow - BOARD_ACTUAL_ROW_BEGIN) + '0');
-    return buf;
-}
+        if (DEBUG_CHECK_ENABLED){
+            debug_check_incremental_states();
+        }
+    }
 
-// every one can only move his pieces, not the enemy's.
-bool check_is_this_your_piece(const ChessBoard& cb, const MoveNode& move, PieceSide side){
-    Piece p = cb.get(move.beginRow, move.beginCol);
-    return piece_get_side(p) == side;
-}
+    // pass the move to the other side, like the null move of the search, no position is repeated across it.
+    void move_null(){
+        history.emplace_back(MoveNode{}, P_EE, 0, 0, key);
+    }
 
-// if no one wins, return PS_EXTRA.
-PieceSide check_winner(const ChessBoard& cb){
-    bool upAlive = false;
-    bool downAlive = false;
+    void undo(){
+        if (!history.empty() && history.back().move == MoveNode{}){    // a null move.
+            history.pop_back();
+        }
+        else if (!history.empty()){   // if history is not empty, reset pieces and pop back.
+            const HistoryNode& node = history.back();
 
-    for (int32_t r = BOARD_9_PALACE_UP_TOP; r <= BOARD_9_PALACE_UP_BOTTOM; ++r) {
-        for (int32_t c = BOARD_9_PALACE_UP_LEFT; c <= BOARD_9_PALACE_UP_RIGHT; ++c) {
-            if (cb.get(r, c) == P_UG) {
-                upAlive = true;
-                break;
+            piece_list_move(node.move.end(), node.move.begin());
+            if (node.endPiece != P_EE){
+                piece_list_restore(node.endPiece, node.move.end(), node.endPieceIndex);
             }
-        }
-    }
 
-    for (int32_t r = BOARD_9_PALACE_DOWN_TOP; r <= BOARD_9_PALACE_DOWN_BOTTOM; ++r) {
-        for (int32_t c = BOARD_9_PALACE_DOWN_LEFT; c <= BOARD_9_PALACE_DOWN_RIGHT; ++c) {
-            if (cb.get(r, c) == P_DG) {
-                downAlive = true;
-                break;
+            if (BITBOARD_MOVEGEN_ENABLED){
+                occupancy_move(node.move, get(node.move.end()), node.endPiece);
             }
+
+            set(node.move.begin(), get(node.move.end()));
+            set(node.move.end(), node.endPiece);
+
+            history.pop_back();
+        }
+
+        if (DEBUG_CHECK_ENABLED){
+            debug_check_incremental_states();
         }
     }
+};
 
-    if (upAlive && downAlive) {
-        return PS_EXTRA;
+/*
+    a fixed capacity move list, lives on the stack or in a pre-allocated search stack,
+    so generating moves never touches the heap.
+*/
+class MoveList{
+    std::array<MoveNode, MAX_ONE_SIDE_POSSIBLE_MOVES_LEN> moves;
+    size_t length;
+public:
+    MoveList()
+        : length{ 0 }
+    {}
+
+    void emplace_back(int32_t beginSquare, int32_t endSquare) noexcept {
+        moves[length++] = MoveNode(beginSquare, endSquare);
     }
-    else if (upAlive) {
-        return PS_UP;
+
+    void push_back(const MoveNode& move) noexcept {
+        moves[length++] = move;
     }
-    else {
-        return PS_DOWN;
+
+    void clear() noexcept {
+        length = 0;
     }
-}
 
-class ConsoleColor {
+    // only shrinks, n must not be bigger than size().
+    void resize(size_t n) noexcept {
+        length = n;
+    }
+
+    size_t size() const noexcept {
+        return length;
+    }
+
+    bool empty() const noexcept {
+        return length == 0;
+    }
+
+    MoveNode& operator[](size_t i) noexcept {
+        return moves[i];
+    }
+
+    const MoveNode& operator[](size_t i) const noexcept {
+        return moves[i];
+    }
+
+    MoveNode* begin() noexcept {
+        return moves.data();
+    }
+
+    MoveNode* end() noexcept {
+        return moves.data() + length;
+    }
+
+    const MoveNode* begin() const noexcept {
+        return moves.data();
+    }
+
+    const MoveNode* end() const noexcept {
+        return moves.data() + length;
+    }
+
+    const MoveNode* cbegin() const noexcept {
+        return moves.data();
+    }
+
+    const MoveNode* cend() const noexcept {
+        return moves.data() + length;
+    }
+};
+
+using PossibleMoves = MoveList;
+
+// bound type of a transposition table entry's score.
+enum TTBound{
+    TTB_NONE,      // empty entry.
+    TTB_EXACT,     // score is the exact value.
+    TTB_LOWER,     // score is a lower bound, the actual value may be bigger.
+    TTB_UPPER      // score is an upper bound, the actual value may be smaller.
+};
+
+struct TTEntry{
+    uint64_t key;
+    MoveNode bestMove;
+    int32_t score;
+    uint16_t depth;
+    uint8_t bound;
+};
+
+/*
+    a slot of transposition table, an entry is packed into the data word:
+        bits  0 ~  1: bound.
+        bits  8 ~ 15: depth, saturated at 255.
+        bits 16 ~ 31: score, saturated to 16 bits.
+        bits 32 ~ 47: best move.
+    the whole key is stored xor-ed with the data, so a probe only hits the same position, and a slot
+    torn by concurrent writers simply doesn't match any key, this makes the table safe to share between
+    threads without locks.
+*/
+struct TTSlot{
+    std::atomic<uint64_t> keyXorData;
+    std::atomic<uint64_t> data;
+};
+
+constexpr int32_t TT_SCORE_MAX = std::numeric_limits<int16_t>::max();
+constexpr int32_t TT_SCORE_MIN = -TT_SCORE_MAX;
+
+inline uint64_t tt_pack_entry(uint16_t depth, TTBound bound, int32_t score, const MoveNode& bestMove){
+    int32_t saturated = std::max(TT_SCORE_MIN, std::min(TT_SCORE_MAX, score));
+
+    return static_cast<uint64_t>(bound) |
+           (static_cast<uint64_t>(std::min<uint16_t>(depth, 255)) << 8) |
+           (static_cast<uint64_t>(static_cast<uint16_t>(saturated)) << 16) |
+           (static_cast<uint64_t>(bestMove.value) << 32);
+}
+
+inline void tt_unpack_entry(uint64_t key, uint64_t data, TTEntry& entry){
+    entry.key = key;
+    entry.bound = static_cast<uint8_t>(data & 0x3);
+    entry.depth = static_cast<uint16_t>((data >> 8) & 0xFF);
+    entry.score = static_cast<int16_t>((data >> 16) & 0xFFFF);
+    entry.bestMove.value = static_cast<uint16_t>((data >> 32) & 0xFFFF);
+}
+
+/*
+    transposition table, remembers the searched positions, so a position reached by
+    different move orders will not be searched again.
+    entries count is always power of two, so a key's slot can be got by masking.
+    probe() and store() are lock-free, one table can be shared by many searching threads.
+*/
+class TranspositionTable{
+    std::unique_ptr<TTSlot[]> slots;
+    uint64_t mask;
+public:
+    explicit TranspositionTable(size_t sizeMB){
+        resize(sizeMB);
+    }
+
+    // the actual size is the biggest power of two entries fit in sizeMB.
+    void resize(size_t sizeMB){
+        size_t count = 1;
+        size_t maxCount = std::max<size_t>(sizeMB * 1024 * 1024 / sizeof(TTSlot), 1);
+
+        while (count * 2 <= maxCount){
+            count *= 2;
+        }
+
+        slots.reset(new TTSlot[count]);
+        mask = count - 1;
+        clear();
+    }
+
+    void clear() noexcept {
+        for (uint64_t i = 0; i <= mask; ++i){
+            slots[i].keyXorData.store(0, std::memory_order_relaxed);
+            slots[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t key, TTEntry& entry) const noexcept {
+        const TTSlot& slot = slots[key & mask];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+        if ((slot.keyXorData.load(std::memory_order_relaxed) ^ data) != key){
+            return false;
+        }
+
+        tt_unpack_entry(key, data, entry);
+        return entry.bound != TTB_NONE;
+    }
+
+    // a different position always replaces the old one, the same position only keeps the deeper result.
+    void store(uint64_t key, uint16_t depth, TTBound bound, int32_t score, const MoveNode& bestMove) noexcept {
+        TTSlot& slot = slots[key & mask];
+
+        TTEntry old;
+        if (probe(key, old) && old.depth > depth){
+            return;
+        }
+
+        uint64_t data = tt_pack_entry(depth, bound, score, bestMove);
+        slot.keyXorData.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+};
+
+// insert the move if the end square is on the chess board and not taken by a piece of Side.
+template <PieceSide Side>
+inline void check_possible_move_and_insert(const ChessBoard& cb, PossibleMoves& pm, int32_t beginSquare, int32_t endSquare){
+    Piece endP = cb.get(endSquare);
+
+    if (endP != P_EO && piece_get_side(endP) != Side){   // not out of chess board, and not the same side.
+        pm.emplace_back(beginSquare, endSquare);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_pawn(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    check_possible_move_and_insert<Side>(cb, pm, sq, sq + side_get_forward_offset(Side));
+
+    bool crossed = Side == PS_UP ? square_get_row(sq) > BOARD_RIVER_UP : square_get_row(sq) < BOARD_RIVER_DOWN;
+    if (crossed){    // cross the river ?
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_LEFT_OFFSET);
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_RIGHT_OFFSET);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_cannon_one_direction(const ChessBoard& cb, PossibleMoves& pm, int32_t sq, int32_t offset){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    int32_t target;
+    Piece p;
+
+    for (target = sq + offset; ;target += offset){
+        p = cb.get(target);
+
+        if (p == P_EE){    // empty piece, then insert it.
+            pm.emplace_back(sq, target);
+        }
+        else {   // upper piece, down piece or out of chess board, break immediately.
+            break;
+        }
+    }
+
+    if (p != P_EO){   // not out of chess board, check if we can add an enemy piece.
+        for (target = target + offset; ;target += offset){
+            p = cb.get(target);
+        
+            if (p == P_EE){    // empty, then continue search.
+                continue;
+            }
+            else if (piece_get_side(p) == ENEMY){   // enemy piece, then insert it and break.
+                pm.emplace_back(sq, target);
+                break;
+            }
+            else {    // self side piece or out of chess board, break.
+                break;
+            }
+        }
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_cannon(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    // go up, down, left, right.
+    gen_moves_cannon_one_direction<Side>(cb, pm, sq, SQUARE_UP_OFFSET);
+    gen_moves_cannon_one_direction<Side>(cb, pm, sq, SQUARE_DOWN_OFFSET);
+    gen_moves_cannon_one_direction<Side>(cb, pm, sq, SQUARE_LEFT_OFFSET);
+    gen_moves_cannon_one_direction<Side>(cb, pm, sq, SQUARE_RIGHT_OFFSET);
+}
+
+template <PieceSide Side>
+void gen_moves_rook_one_direction(const ChessBoard& cb, PossibleMoves& pm, int32_t sq, int32_t offset){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    int32_t target;
+    Piece p;
+
+    for (target = sq + offset; ;target += offset){
+        p = cb.get(target);
+
+        if (p == P_EE){    // empty piece, then insert it.
+            pm.emplace_back(sq, target);
+        }
+        else {   // upper piece, down piece or out of chess board, break immediately.
+            break;
+        }
+    }
+
+    if (piece_get_side(p) == ENEMY){   // enemy piece, then insert it.
+        pm.emplace_back(sq, target);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_rook(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    // go up, down, left, right.
+    gen_moves_rook_one_direction<Side>(cb, pm, sq, SQUARE_UP_OFFSET);
+    gen_moves_rook_one_direction<Side>(cb, pm, sq, SQUARE_DOWN_OFFSET);
+    gen_moves_rook_one_direction<Side>(cb, pm, sq, SQUARE_LEFT_OFFSET);
+    gen_moves_rook_one_direction<Side>(cb, pm, sq, SQUARE_RIGHT_OFFSET);
+}
+
+template <PieceSide Side>
+void gen_moves_knight(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    if (cb.get(sq + SQUARE_DOWN_OFFSET) == P_EE){    // if not lame horse leg ?
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET);
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET);
+    }
+
+    if (cb.get(sq + SQUARE_UP_OFFSET) == P_EE){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET);
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET);
+    }
+
+    if (cb.get(sq + SQUARE_RIGHT_OFFSET) == P_EE){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_RIGHT_OFFSET + SQUARE_DOWN_OFFSET);
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_RIGHT_OFFSET + SQUARE_UP_OFFSET);
+    }
+
+    if (cb.get(sq + SQUARE_LEFT_OFFSET) == P_EE){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_LEFT_OFFSET + SQUARE_DOWN_OFFSET);
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * SQUARE_LEFT_OFFSET + SQUARE_UP_OFFSET);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_bishop(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    constexpr int32_t FORWARD_RIGHT  = side_get_forward_offset(Side) + SQUARE_RIGHT_OFFSET;
+    constexpr int32_t FORWARD_LEFT   = side_get_forward_offset(Side) + SQUARE_LEFT_OFFSET;
+    constexpr int32_t BACKWARD_RIGHT = -side_get_forward_offset(Side) + SQUARE_RIGHT_OFFSET;
+    constexpr int32_t BACKWARD_LEFT  = -side_get_forward_offset(Side) + SQUARE_LEFT_OFFSET;
+
+    int32_t r = square_get_row(sq);
+
+    bool canGoForward = Side == PS_UP ? r + 2 <= BOARD_RIVER_UP : r - 2 >= BOARD_RIVER_DOWN;
+    if (canGoForward){       // bishop can't cross river.
+        if (cb.get(sq + FORWARD_RIGHT) == P_EE){    // bishop can move only if Xiang Yan is empty.
+            check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * FORWARD_RIGHT);
+        }
+
+        if (cb.get(sq + FORWARD_LEFT) == P_EE){
+            check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * FORWARD_LEFT);
+        }
+    }
+
+    if (cb.get(sq + BACKWARD_RIGHT) == P_EE){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * BACKWARD_RIGHT);
+    }
+
+    if (cb.get(sq + BACKWARD_LEFT) == P_EE){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + 2 * BACKWARD_LEFT);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_advisor(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    constexpr int32_t PALACE_TOP    = Side == PS_UP ? BOARD_9_PALACE_UP_TOP : BOARD_9_PALACE_DOWN_TOP;
+    constexpr int32_t PALACE_BOTTOM = Side == PS_UP ? BOARD_9_PALACE_UP_BOTTOM : BOARD_9_PALACE_DOWN_BOTTOM;
+    constexpr int32_t PALACE_LEFT   = Side == PS_UP ? BOARD_9_PALACE_UP_LEFT : BOARD_9_PALACE_DOWN_LEFT;
+    constexpr int32_t PALACE_RIGHT  = Side == PS_UP ? BOARD_9_PALACE_UP_RIGHT : BOARD_9_PALACE_DOWN_RIGHT;
+
+    int32_t r = square_get_row(sq);
+    int32_t c = square_get_col(sq);
+
+    if (r + 1 <= PALACE_BOTTOM && c + 1 <= PALACE_RIGHT) {   // walk diagonal lines.
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET);
+    }
+
+    if (r + 1 <= PALACE_BOTTOM && c - 1 >= PALACE_LEFT) {
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET);
+    }
+
+    if (r - 1 >= PALACE_TOP && c + 1 <= PALACE_RIGHT) {
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET);
+    }
+
+    if (r - 1 >= PALACE_TOP && c - 1 >= PALACE_LEFT) {
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_general(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    constexpr int32_t PALACE_TOP    = Side == PS_UP ? BOARD_9_PALACE_UP_TOP : BOARD_9_PALACE_DOWN_TOP;
+    constexpr int32_t PALACE_BOTTOM = Side == PS_UP ? BOARD_9_PALACE_UP_BOTTOM : BOARD_9_PALACE_DOWN_BOTTOM;
+    constexpr int32_t PALACE_LEFT   = Side == PS_UP ? BOARD_9_PALACE_UP_LEFT : BOARD_9_PALACE_DOWN_LEFT;
+    constexpr int32_t PALACE_RIGHT  = Side == PS_UP ? BOARD_9_PALACE_UP_RIGHT : BOARD_9_PALACE_DOWN_RIGHT;
+    constexpr Piece ENEMY_GENERAL   = piece_make(piece_side_get_reverse(Side), PT_GENERAL);
+
+    int32_t r = square_get_row(sq);
+    int32_t c = square_get_col(sq);
+    int32_t target;
+    Piece p;
+
+    if (r + 1 <= PALACE_BOTTOM){   // walk horizontal or vertical.
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_DOWN_OFFSET);
+    }
+
+    if (r - 1 >= PALACE_TOP){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_UP_OFFSET);
+    }
+
+    if (c + 1 <= PALACE_RIGHT){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_RIGHT_OFFSET);
+    }
+
+    if (c - 1 >= PALACE_LEFT){
+        check_possible_move_and_insert<Side>(cb, pm, sq, sq + SQUARE_LEFT_OFFSET);
+    }
+
+    // check if both generals faced each other directly.
+    constexpr int32_t FORWARD = side_get_forward_offset(Side);
+    for (target = sq + FORWARD; (p = cb.get(target)) != P_EO; target += FORWARD){
+        if (p == P_EE){
+            continue;
+        }
+        else if (p == ENEMY_GENERAL){
+            pm.emplace_back(sq, target);
+            break;
+        }
+        else {
+            break;
+        }
+    }
+}
+
+// generate moves for all the pieces of Side and type from the piece list.
+template <PieceSide Side, typename GenFunc>
+inline void gen_moves_for_pieces(const ChessBoard& cb, PossibleMoves& pm, PieceType type, GenFunc gen){
+    Piece p = piece_make(Side, type);
+    const uint8_t* squares = cb.get_piece_squares(p);
+
+    for (int32_t i = 0, n = cb.get_piece_count(p); i < n; ++i){
+        gen(cb, pm, squares[i]);
+    }
+}
+
+// the reference mailbox generator.
+template <PieceSide Side>
+void gen_possible_moves_mailbox(const ChessBoard& cb, PossibleMoves& pm){
+    pm.clear();
+
+    // the search has no move ordering except the hash move, so the active pieces go first.
+    gen_moves_for_pieces<Side>(cb, pm, PT_KNIGHT, gen_moves_knight<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_ROOK, gen_moves_rook<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_CANNON, gen_moves_cannon<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_PAWN, gen_moves_pawn<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_BISHOP, gen_moves_bishop<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_ADVISOR, gen_moves_advisor<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_GENERAL, gen_moves_general<Side>);
+}
+
+void gen_moves_bitboard_targets(PossibleMoves& pm, int32_t sq, const Bitboard& targets){
+    for (uint64_t bits = targets.words[0]; bits != 0; bits &= bits - 1){
+        pm.emplace_back(sq, index_get_square(bit_scan_forward(bits)));
+    }
+
+    for (uint64_t bits = targets.words[1]; bits != 0; bits &= bits - 1){
+        pm.emplace_back(sq, index_get_square(64 + bit_scan_forward(bits)));
+    }
+}
+
+// targets of a rank, bit i is column i.
+void gen_moves_bitboard_rank_targets(PossibleMoves& pm, int32_t sq, uint32_t targets){
+    int32_t rowBegin = square_make(square_get_row(sq), BOARD_ACTUAL_COL_BEGIN);
+
+    for (; targets != 0; targets &= targets - 1){
+        pm.emplace_back(sq, rowBegin + bit_scan_forward(targets));
+    }
+}
+
+// targets of a file, bit i is row i.
+void gen_moves_bitboard_file_targets(PossibleMoves& pm, int32_t sq, uint32_t targets){
+    int32_t colBegin = square_make(BOARD_ACTUAL_ROW_BEGIN, square_get_col(sq));
+
+    for (; targets != 0; targets &= targets - 1){
+        pm.emplace_back(sq, colBegin + bit_scan_forward(targets) * BOARD_ACTUAL_COL_LEN);
+    }
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_pawn(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    const Bitboard& attacks = bitboardTables.pawnAttacks[Side][square_get_index(sq)];
+    gen_moves_bitboard_targets(pm, sq, attacks & ~cb.get_side_occupancy(Side));
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_cannon(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    int32_t r = square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN;
+    int32_t c = square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;
+    uint32_t rankEnemy = cb.get_rank_occupancy(ENEMY, r);
+    uint32_t rankAll = rankEnemy | cb.get_rank_occupancy(Side, r);
+    uint32_t fileEnemy = cb.get_file_occupancy(ENEMY, c);
+    uint32_t fileAll = fileEnemy | cb.get_file_occupancy(Side, c);
+    uint32_t rankLine = bitboard_get_rank_line(c, rankAll);
+    uint32_t fileLine = bitboard_get_file_line(r, fileAll);
+
+    // walk to the empty squares, jump over a screen to capture.
+    gen_moves_bitboard_rank_targets(pm, sq, (rankLine & 0xFFFF & ~rankAll) | ((rankLine >> 16) & rankEnemy));
+    gen_moves_bitboard_file_targets(pm, sq, (fileLine & 0xFFFF & ~fileAll) | ((fileLine >> 16) & fileEnemy));
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_rook(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    int32_t r = square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN;
+    int32_t c = square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;
+    uint32_t rankSelf = cb.get_rank_occupancy(Side, r);
+    uint32_t fileSelf = cb.get_file_occupancy(Side, c);
+    uint32_t rankLine = bitboard_get_rank_line(c, rankSelf | cb.get_rank_occupancy(ENEMY, r));
+    uint32_t fileLine = bitboard_get_file_line(r, fileSelf | cb.get_file_occupancy(ENEMY, c));
+
+    gen_moves_bitboard_rank_targets(pm, sq, rankLine & 0xFFFF & ~rankSelf);
+    gen_moves_bitboard_file_targets(pm, sq, fileLine & 0xFFFF & ~fileSelf);
+}
+
+// the targets behind the legs or eyes which are not blocked.
+inline Bitboard bitboard_get_unblocked_attacks(const ChessBoard& cb, const uint8_t (&blockers)[4], const Bitboard (&attacks)[4]){
+    Bitboard all = cb.get_side_occupancy(PS_UP) | cb.get_side_occupancy(PS_DOWN);
+    Bitboard result;
+
+    for (int32_t i = 0; i < 4; ++i){
+        uint64_t open = uint64_t(all.test(blockers[i])) - 1;    // all ones if not blocked.
+
+        result.words[0] |= attacks[i].words[0] & open;
+        result.words[1] |= attacks[i].words[1] & open;
+    }
+
+    return result;
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_knight(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    int32_t index = square_get_index(sq);
+    Bitboard attacks = bitboard_get_unblocked_attacks(cb, bitboardTables.knightLegs[index], bitboardTables.knightAttacks[index]);
+
+    gen_moves_bitboard_targets(pm, sq, attacks & ~cb.get_side_occupancy(Side));
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_bishop(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    int32_t index = square_get_index(sq);
+    Bitboard attacks = bitboard_get_unblocked_attacks(cb, bitboardTables.bishopEyes[index], bitboardTables.bishopAttacks[index]);
+
+    gen_moves_bitboard_targets(pm, sq, attacks & bitboardTables.sideHalves[Side] & ~cb.get_side_occupancy(Side));
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_advisor(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    const Bitboard& attacks = bitboardTables.advisorAttacks[Side][square_get_index(sq)];
+    gen_moves_bitboard_targets(pm, sq, attacks & ~cb.get_side_occupancy(Side));
+}
+
+template <PieceSide Side>
+void gen_moves_bitboard_general(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    const Bitboard& attacks = bitboardTables.generalAttacks[Side][square_get_index(sq)];
+    gen_moves_bitboard_targets(pm, sq, attacks & ~cb.get_side_occupancy(Side));
+
+    // check if both generals faced each other directly.
+    int32_t enemyGeneral = cb.get_general_square(piece_side_get_reverse(Side));
+
+    if (enemyGeneral != 0 && square_get_col(enemyGeneral) == square_get_col(sq)){
+        int32_t r = square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN;
+        int32_t c = square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;
+        uint32_t fileAll = cb.get_file_occupancy(PS_UP, c) | cb.get_file_occupancy(PS_DOWN, c);
+
+        if (bitboard_get_file_line(r, fileAll) & (1 << (square_get_row(enemyGeneral) - BOARD_ACTUAL_ROW_BEGIN))){
+            pm.emplace_back(sq, enemyGeneral);
+        }
+    }
+}
+
+// the bitboard generator, selected by BITBOARD_MOVEGEN_ENABLED.
+template <PieceSide Side>
+void gen_possible_moves_bitboard(const ChessBoard& cb, PossibleMoves& pm){
+    pm.clear();
+
+    gen_moves_for_pieces<Side>(cb, pm, PT_KNIGHT, gen_moves_bitboard_knight<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_ROOK, gen_moves_bitboard_rook<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_CANNON, gen_moves_bitboard_cannon<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_PAWN, gen_moves_bitboard_pawn<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_BISHOP, gen_moves_bitboard_bishop<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_ADVISOR, gen_moves_bitboard_advisor<Side>);
+    gen_moves_for_pieces<Side>(cb, pm, PT_GENERAL, gen_moves_bitboard_general<Side>);
+}
+
+// compare the bitboard generator with the mailbox one, abort if they are different.
+template <PieceSide Side>
+void debug_check_bitboard_moves(const ChessBoard& cb, const PossibleMoves& pm){
+    PossibleMoves reference;
+    gen_possible_moves_mailbox<Side>(cb, reference);
+
+    std::vector<uint16_t> expected, actual;
+    for (const MoveNode& m : reference){
+        expected.push_back(m.value);
+    }
+    for (const MoveNode& m : pm){
+        actual.push_back(m.value);
+    }
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+
+    if (expected != actual){
+        std::cerr << "debug check failed: bitboard generator made " << actual.size()
+                  << " moves, mailbox generator made " << expected.size() << " moves.\n";
+        std::abort();
+    }
+}
+
+// generate possible moves of Side into pm, the old moves in pm are cleared.
+template <PieceSide Side>
+void gen_possible_moves(const ChessBoard& cb, PossibleMoves& pm){
+    if (BITBOARD_MOVEGEN_ENABLED){
+        gen_possible_moves_bitboard<Side>(cb, pm);
+
+        if (DEBUG_CHECK_ENABLED){
+            debug_check_bitboard_moves<Side>(cb, pm);
+        }
+    }
+    else {
+        gen_possible_moves_mailbox<Side>(cb, pm);
+    }
+}
+
+// the same as above for a side only known at runtime, the search should call the template with a pre-allocated list.
+void gen_possible_moves(const ChessBoard& cb, PieceSide side, PossibleMoves& pm){
+    if (side == PS_UP){
+        gen_possible_moves<PS_UP>(cb, pm);
+    }
+    else if (side == PS_DOWN){
+        gen_possible_moves<PS_DOWN>(cb, pm);
+    }
+    else {
+        pm.clear();
+    }
+}
+
+// generate possible moves for one side, the searching should use the version above with a pre-allocated list.
+PossibleMoves gen_possible_moves(const ChessBoard& cb, PieceSide side){
+    PossibleMoves pm;
+    gen_possible_moves(cb, side, pm);
+    return pm;
+}
+
+/*
+    check if the general of Side is attacked, by looking from the general outwards:
+    rooks and the enemy general on the lines, cannons behind a screen, knights whose leg is empty, and pawns next to it.
+    return false if the general has been captured.
+*/
+template <PieceSide Side>
+bool is_in_check(const ChessBoard& cb){
+    constexpr int32_t LINES[4] = { SQUARE_UP_OFFSET, SQUARE_DOWN_OFFSET, SQUARE_LEFT_OFFSET, SQUARE_RIGHT_OFFSET };
+    constexpr int32_t DIAGONALS[4][2] = { { -1, -1 }, { -1, +1 }, { +1, -1 }, { +1, +1 } };   // row and col steps.
+
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+    constexpr Piece ENEMY_ROOK = piece_make(ENEMY, PT_ROOK);
+    constexpr Piece ENEMY_CANNON = piece_make(ENEMY, PT_CANNON);
+    constexpr Piece ENEMY_KNIGHT = piece_make(ENEMY, PT_KNIGHT);
+    constexpr Piece ENEMY_PAWN = piece_make(ENEMY, PT_PAWN);
+    constexpr Piece ENEMY_GENERAL = piece_make(ENEMY, PT_GENERAL);
+
+    int32_t general = cb.get_general_square(Side);
+    if (general == 0){
+        return false;
+    }
+
+    for (int32_t offset : LINES){
+        int32_t target = general + offset;
+        while (cb.get(target) == P_EE){
+            target += offset;
+        }
+
+        Piece p = cb.get(target);
+        if (p == ENEMY_ROOK || (p == ENEMY_GENERAL && (offset == SQUARE_UP_OFFSET || offset == SQUARE_DOWN_OFFSET))){
+            return true;
+        }
+
+        if (p == P_EO){
+            continue;
+        }
+
+        // p is the screen, look for a cannon behind it.
+        for (target += offset; cb.get(target) == P_EE; target += offset){
+        }
+
+        if (cb.get(target) == ENEMY_CANNON){
+            return true;
+        }
+    }
+
+    for (const int32_t (&d)[2] : DIAGONALS){
+        int32_t leg = general + d[0] * SQUARE_DOWN_OFFSET + d[1] * SQUARE_RIGHT_OFFSET;
+
+        if (cb.get(leg) == P_EE &&
+            (cb.get(leg + d[0] * SQUARE_DOWN_OFFSET) == ENEMY_KNIGHT || cb.get(leg + d[1] * SQUARE_RIGHT_OFFSET) == ENEMY_KNIGHT)){
+            return true;
+        }
+    }
+
+    // an enemy pawn attacks forward, or sideways after crossing the river, it is across the river if it is next to the general.
+    return cb.get(general - side_get_forward_offset(ENEMY)) == ENEMY_PAWN ||
+           cb.get(general + SQUARE_LEFT_OFFSET) == ENEMY_PAWN ||
+           cb.get(general + SQUARE_RIGHT_OFFSET) == ENEMY_PAWN;
+}
+
+// the same as above for a side only known at runtime.
+bool is_in_check(const ChessBoard& cb, PieceSide side){
+    if (side == PS_UP){
+        return is_in_check<PS_UP>(cb);
+    }
+    else if (side == PS_DOWN){
+        return is_in_check<PS_DOWN>(cb);
+    }
+
+    return false;
+}
+
+/*
+    ChessBoard::set_fen(), but a position where the side not to move is in check(facing generals too) is
+    not valid either, its general could be captured. the board holds that position if it is rejected for it.
+*/
+bool board_set_fen(ChessBoard& cb, const std::string& fen, PieceSide& sideToMove){
+    PieceSide side = PS_DOWN;
+    if (!cb.set_fen(fen, side) || is_in_check(cb, piece_side_get_reverse(side))){
+        return false;
+    }
+
+    sideToMove = side;
+    return true;
+}
+
+/*
+    if a move may leave its own general attacked, when the general was not in check before it.
+    only these moves can: moves of the general, moves from the general's rank or file(a rook or the enemy
+    general behind may see it, a cannon may lose one of its two screens), moves from a knight leg next to
+    the general, and moves to the general's rank or file(a cannon may get a screen).
+*/
+inline bool move_may_expose_general(const MoveNode& move, int32_t general){
+    int32_t begin = move.begin();
+    int32_t end = move.end();
+    int32_t generalRow = square_get_row(general);
+    int32_t generalCol = square_get_col(general);
+
+    if (square_get_row(begin) == generalRow || square_get_col(begin) == generalCol ||
+        square_get_row(end) == generalRow || square_get_col(end) == generalCol){
+        return true;    // including the general itself.
+    }
+
+    int32_t offset = begin - general;
+    return offset == SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET || offset == SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET ||
+           offset == SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET || offset == SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET;
+}
+
+/*
+    if the move of Side, which has just been made on cb, left its own general attacked.
+    general and inCheck are got before the move, a move is only verified if it may expose the general.
+*/
+template <PieceSide Side>
+inline bool move_exposes_general(const ChessBoard& cb, const MoveNode& move, int32_t general, bool inCheck){
+    return (inCheck || move_may_expose_general(move, general)) && is_in_check<Side>(cb);
+}
+
+/*
+    generate legal moves of Side into pm, the moves which leave its own general attacked are removed.
+    the moves which may expose the general are made on cb to be verified, cb is the same after it returns.
+    the search checks the same thing when a move is made instead, so the moves after a cutoff are never verified.
+*/
+template <PieceSide Side>
+void gen_legal_moves(ChessBoard& cb, PossibleMoves& pm){
+    gen_possible_moves<Side>(cb, pm);
+
+    int32_t general = cb.get_general_square(Side);
+    bool inCheck = is_in_check<Side>(cb);
+    size_t legalLen = 0;
+
+    for (size_t i = 0; i < pm.size(); ++i){
+        MoveNode move = pm[i];
+
+        if (inCheck || move_may_expose_general(move, general)){
+            cb.move(move);
+            bool exposed = is_in_check<Side>(cb);
+            cb.undo();
+
+            if (exposed){
+                continue;
+            }
+        }
+
+        pm[legalLen++] = move;
+    }
+
+    pm.resize(legalLen);
+}
+
+// the same as above for a side only known at runtime.
+void gen_legal_moves(ChessBoard& cb, PieceSide side, PossibleMoves& pm){
+    if (side == PS_UP){
+        gen_legal_moves<PS_UP>(cb, pm);
+    }
+    else if (side == PS_DOWN){
+        gen_legal_moves<PS_DOWN>(cb, pm);
+    }
+    else {
+        pm.clear();
+    }
+}
+
+PossibleMoves gen_legal_moves(ChessBoard& cb, PieceSide side){
+    PossibleMoves pm;
+    gen_legal_moves(cb, side, pm);
+    return pm;
+}
+
+// generate the moves of the piece of Side on sq into pm.
+template <PieceSide Side>
+void gen_moves_of_square(const ChessBoard& cb, PossibleMoves& pm, int32_t sq){
+    switch (piece_get_type(cb.get(sq))){
+    case PT_PAWN: gen_moves_pawn<Side>(cb, pm, sq); break;
+    case PT_CANNON: gen_moves_cannon<Side>(cb, pm, sq); break;
+    case PT_ROOK: gen_moves_rook<Side>(cb, pm, sq); break;
+    case PT_KNIGHT: gen_moves_knight<Side>(cb, pm, sq); break;
+    case PT_BISHOP: gen_moves_bishop<Side>(cb, pm, sq); break;
+    case PT_ADVISOR: gen_moves_advisor<Side>(cb, pm, sq); break;
+    case PT_GENERAL: gen_moves_general<Side>(cb, pm, sq); break;
+    default: break;
+    }
+}
+
+void gen_moves_of_square(const ChessBoard& cb, PieceSide side, PossibleMoves& pm, int32_t sq){
+    if (side == PS_UP){
+        gen_moves_of_square<PS_UP>(cb, pm, sq);
+    }
+    else {
+        gen_moves_of_square<PS_DOWN>(cb, pm, sq);
+    }
+}
+
+/* 
+    calculate a chess board's score, the sum of every piece's value and position value.
+    upper side value is negative, down side is positive.
+    the chess board keeps it updated in move() and undo(), so this is O(1).
+*/
+int32_t board_calc_score(const ChessBoard& cb){
+    return cb.get_score();
+}
+
+/*
+    the negamax search scores a position for the side to move, board_calc_score() scores it for the down side.
+    this converts one to the other, in both directions.
+*/
+constexpr int32_t score_for_side(int32_t score, PieceSide side){
+    return side == PS_DOWN ? score : -score;
+}
+
+// mate scores are counted from the root, the transposition table keeps them counted from the node instead.
+inline int32_t score_to_tt(int32_t score, int32_t ply){
+    if (score >= SCORE_MATE_BOUND){
+        return score + ply;
+    }
+    else if (score <= -SCORE_MATE_BOUND){
+        return score - ply;
+    }
+
+    return score;
+}
+
+inline int32_t score_from_tt(int32_t score, int32_t ply){
+    if (score >= SCORE_MATE_BOUND){
+        return score - ply;
+    }
+    else if (score <= -SCORE_MATE_BOUND){
+        return score + ply;
+    }
+
+    return score;
+}
+
+// move the hash move(if it is a possible move) to the front, so it will be searched first.
+void put_hash_move_first(PossibleMoves& pm, const MoveNode& hashMove){
+    auto it = std::find(pm.begin(), pm.end(), hashMove);
+
+    if (it != pm.end()){
+        std::rotate(pm.begin(), it, it + 1);
+    }
+}
+
+// how a repeated position is scored, by the search and when the game is judged.
+enum RepetitionRule{
+    RR_DRAW,           // every repetition is a draw.
+    RR_LONG_CHECK,     // the side which checked on every move of the cycle loses, other repetitions are draws.
+    RR_LONG_CHASE,     // like RR_LONG_CHECK, and the side which checked or chased on every move of the cycle loses.
+};
+
+// set by --repetition before the game, and only read after.
+RepetitionRule repetitionRule = RR_DRAW;
+
+/*
+    if the piece which just made the move chases: it can capture a piece which is not a general or a pawn,
+    and is worth more than itself or can't be captured back. cb is the same after it returns.
+    captures and replies are only used as buffers, the search passes its pre-allocated move lists.
+*/
+bool move_is_chase(ChessBoard& cb, const MoveNode& move, PossibleMoves& captures, PossibleMoves& replies){
+    Piece chaser = cb.get(move.end());
+    PieceSide side = piece_get_side(chaser);
+
+    captures.clear();
+    gen_moves_of_square(cb, side, captures, move.end());
+    for (const MoveNode& capture : captures){
+        Piece victim = cb.get(capture.end());
+        if (victim == P_EE || piece_get_type(victim) == PT_GENERAL || piece_get_type(victim) == PT_PAWN){
+            continue;
+        }
+
+        if (std::abs(piece_get_value(victim)) > std::abs(piece_get_value(chaser))){
+            return true;
+        }
+
+        cb.move(capture);
+        replies.clear();
+        gen_possible_moves(cb, piece_side_get_reverse(side), replies);
+        bool defended = std::any_of(replies.begin(), replies.end(), [&capture](const MoveNode& reply){
+            return reply.end() == capture.end();
+        });
+        cb.undo();
+
+        if (!defended){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    for every one of the last plies moves of cb, clear checking[mover] or chasing[mover] of the side which made it
+    if it didn't check or chase. the moves are undone one by one and made again on the way back, so the cycle is
+    judged in place, and it stops undoing once neither side can lose by the rule.
+*/
+void repetition_judge_cycle(ChessBoard& cb, int32_t plies, RepetitionRule rule, std::array<bool, 2>& checking, std::array<bool, 2>& chasing,
+                            PossibleMoves& captures, PossibleMoves& replies){
+    if (plies == 0 || !(checking[0] || checking[1] || chasing[0] || chasing[1])){
+        return;
+    }
+
+    MoveNode move = cb.get_last_move();
+    PieceSide mover = piece_get_side(cb.get(move.end()));
+    bool check = is_in_check(cb, piece_side_get_reverse(mover));
+    checking[mover] = checking[mover] && check;
+    chasing[mover] = chasing[mover] && rule == RR_LONG_CHASE && (check || move_is_chase(cb, move, captures, replies));
+
+    cb.undo();
+    repetition_judge_cycle(cb, plies - 1, rule, checking, chasing, captures, replies);
+    cb.move(move);
+}
+
+/*
+    judge the last distance plies of cb, which repeated the position, for side to move by the rule:
+    1 if side wins, -1 if it loses, 0 for a draw. cb is the same after it returns.
+    captures and replies are only used as buffers, see move_is_chase().
+*/
+int32_t repetition_judge(ChessBoard& cb, int32_t distance, PieceSide side, RepetitionRule rule, PossibleMoves& captures, PossibleMoves& replies){
+    if (rule == RR_DRAW){
+        return 0;
+    }
+
+    std::array<bool, 2> checking{ { true, true } };
+    std::array<bool, 2> chasing{ { true, true } };
+    repetition_judge_cycle(cb, distance, rule, checking, chasing, captures, replies);
+
+    PieceSide enemy = piece_side_get_reverse(side);
+    if (checking[side] != checking[enemy]){
+        return checking[side] ? -1 : 1;
+    }
+    else if (chasing[side] != chasing[enemy]){
+        return chasing[side] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+    a file mapped into memory read only, its pages are read by the system when they are touched,
+    so a big file is neither read at once nor copied.
+*/
+class MappedFile{
+    void* view;
+    size_t viewSize;
+public:
+    MappedFile()
+        : view{ nullptr }, viewSize{ 0 }
+    {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile(){
+        close();
+    }
+
+    // return false if the file can't be mapped, an empty file can't be.
+    bool open(const std::string& path){
+        close();
+
+        #ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE){
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0){
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        CloseHandle(file);      // the mapping keeps the file open.
+        if (mapping == nullptr){
+            return false;
+        }
+
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);   // the view keeps the mapping.
+        if (view == nullptr){
+            return false;
+        }
+        viewSize = static_cast<size_t>(fileSize.QuadPart);
+        #else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0){
+            return false;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0){
+            view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            view = view == MAP_FAILED ? nullptr : view;
+        }
+        ::close(fd);            // the mapping keeps the file open.
+        if (view == nullptr){
+            return false;
+        }
+        viewSize = static_cast<size_t>(fileStat.st_size);
+        #endif
+
+        return true;
+    }
+
+    void close() noexcept {
+        if (view != nullptr){
+            #ifdef _WIN32
+            UnmapViewOfFile(view);
+            #else
+            munmap(view, viewSize);
+            #endif
+        }
+
+        view = nullptr;
+        viewSize = 0;
+    }
+
+    bool is_open() const noexcept {
+        return view != nullptr;
+    }
+
+    const char* data() const noexcept {
+        return static_cast<const char*>(view);
+    }
+
+    size_t size() const noexcept {
+        return viewSize;
+    }
+};
+
+// the records of key in records sorted by their key member, [first, second) is empty if there is none.
+template <typename Record>
+std::pair<const Record*, const Record*> find_records_by_key(const Record* records, size_t count, uint64_t key) noexcept {
+    const Record* first = std::lower_bound(records, records + count, key,
+        [](const Record& record, uint64_t k){ return record.key < k; });
+    const Record* last = first;
+    while (last != records + count && last->key == key){
+        ++last;
+    }
+
+    return std::make_pair(first, last);
+}
+
+/*
+    an endgame tablebase keeps the outcome of every position of some small materials. a material is both
+    generals and up to TABLEBASE_MAX_PIECES other pieces, its code packs the count of every piece in 3 bits.
+    a position is indexed by the squares of its pieces among the squares they can reach from the start position,
+    identical pieces by the combination of their squares, so they are counted once, and the side to move.
+*/
+struct TablebaseIndexing{
+    std::array<std::array<uint8_t, BOARD_INDEX_LEN>, P_EE> squares;        // reachable squares of every piece, ascending.
+    std::array<uint8_t, P_EE> counts;
+    std::array<std::array<int8_t, BOARD_SQUARE_LEN>, P_EE> indexes;       // index of a square in squares, -1 if unreachable.
+    std::array<std::array<uint64_t, TABLEBASE_MAX_PIECES + 1>, BOARD_INDEX_LEN + 1> binomials;
+
+    TablebaseIndexing(){
+        for (int32_t p = 0; p < P_EE; ++p){
+            counts[p] = 0;
+            for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+                indexes[p][sq] = -1;
+                if (is_reachable(static_cast<Piece>(p), sq)){
+                    indexes[p][sq] = static_cast<int8_t>(counts[p]);
+                    squares[p][counts[p]++] = static_cast<uint8_t>(sq);
+                }
+            }
+        }
+
+        for (int32_t n = 0; n <= BOARD_INDEX_LEN; ++n){
+            for (uint32_t k = 0; k <= TABLEBASE_MAX_PIECES; ++k){
+                binomials[n][k] = k == 0 ? 1 : (n == 0 ? 0 : binomials[n - 1][k - 1] + binomials[n - 1][k]);
+            }
+        }
+    }
+
+    // a bishop reaches 7 squares, an advisor 5, a general 9, a pawn 55, and the others the whole board.
+    static bool is_reachable(Piece p, int32_t sq){
+        if (!square_is_on_board(sq)){
+            return false;
+        }
+
+        int32_t r = piece_get_side(p) == PS_UP ? square_get_row(sq) - BOARD_ACTUAL_ROW_BEGIN : BOARD_ACTUAL_ROW_END - square_get_row(sq);
+        int32_t c = square_get_col(sq) - BOARD_ACTUAL_COL_BEGIN;     // both r and c are counted from this side's bottom left.
+
+        switch (piece_get_type(p)){
+        case PT_GENERAL:
+            return r <= 2 && c >= 3 && c <= 5;
+        case PT_ADVISOR:
+            return r <= 2 && c >= 3 && c <= 5 && (r + c) % 2 == 1;
+        case PT_BISHOP:
+            return r <= 4 && r % 2 == 0 && c % 2 == 0 && (r / 2 + c / 2) % 2 == 1;
+        case PT_PAWN:
+            return r >= 5 || (r >= 3 && c % 2 == 0);
+        default:
+            return true;
+        }
+    }
+};
+
+const TablebaseIndexing tablebaseIndexing;
+
+// a material of an endgame tablebase.
+struct TablebaseMaterial{
+    uint64_t code;
+    uint32_t count;                                       // pieces besides the generals.
+    std::array<Piece, TABLEBASE_MAX_PIECES> pieces;       // sorted, so identical pieces are next to each other.
+    uint64_t size;                                        // number of positions.
+};
+
+// the material of a code, false if it has a general, more than TABLEBASE_MAX_PIECES pieces or too many of one kind.
+bool tablebase_material_from_code(uint64_t code, TablebaseMaterial& material){
+    const TablebaseIndexing& t = tablebaseIndexing;
+
+    material.code = code;
+    material.count = 0;
+    material.size = 2 * t.counts[P_UG] * t.counts[P_DG];
+    for (int32_t p = 0; p < P_EE; ++p){
+        int32_t n = static_cast<int32_t>((code >> (3 * p)) & 7);
+        if (n == 0){
+            continue;
+        }
+
+        PieceType type = piece_get_type(static_cast<Piece>(p));
+        if (type == PT_GENERAL || n > pieceTypeMaxCountMapping[type] || material.count + n > TABLEBASE_MAX_PIECES){
+            return false;
+        }
+
+        for (int32_t i = 0; i < n; ++i){
+            material.pieces[material.count++] = static_cast<Piece>(p);
+        }
+
+        material.size *= t.binomials[t.counts[p]][n];
+    }
+
+    return (code >> (3 * P_EE)) == 0;
+}
+
+// the material code of the pieces on the board, count is set to the number of pieces besides the generals.
+inline uint64_t tablebase_get_code(const ChessBoard& cb, uint32_t& count){
+    uint64_t code = 0;
+
+    count = 0;
+    for (int32_t p = 0; p < P_EE; ++p){
+        if (piece_get_type(static_cast<Piece>(p)) != PT_GENERAL){
+            uint32_t n = static_cast<uint32_t>(cb.get_piece_count(static_cast<Piece>(p)));
+            code |= static_cast<uint64_t>(n) << (3 * p);
+            count += n;
+        }
+    }
+
+    return code;
+}
+
+// index of the position in the table of its material, false if a piece stands where it can't be reached.
+bool tablebase_encode(const TablebaseMaterial& material, const ChessBoard& cb, PieceSide side, uint64_t& index){
+    const TablebaseIndexing& t = tablebaseIndexing;
+    int32_t up = t.indexes[P_UG][cb.get_general_square(PS_UP)];
+    int32_t down = t.indexes[P_DG][cb.get_general_square(PS_DOWN)];
+
+    if (up < 0 || down < 0){
+        return false;
+    }
+
+    index = static_cast<uint64_t>(up) * t.counts[P_DG] + down;
+    for (uint32_t i = 0; i < material.count; ){
+        Piece p = material.pieces[i];
+        int32_t n = cb.get_piece_count(p);
+        const uint8_t* squares = cb.get_piece_squares(p);
+        std::array<int32_t, MAX_ONE_KIND_PIECES_LEN> sorted;
+
+        for (int32_t j = 0; j < n; ++j){
+            sorted[j] = t.indexes[p][squares[j]];
+            if (sorted[j] < 0){
+                return false;
+            }
+        }
+
+        // identical pieces are ranked by the combinatorial number system.
+        std::sort(sorted.begin(), sorted.begin() + n);
+        uint64_t rank = 0;
+        for (int32_t j = 0; j < n; ++j){
+            rank += t.binomials[sorted[j]][j + 1];
+        }
+
+        index = index * t.binomials[t.counts[p]][n] + rank;
+        i += n;
+    }
+
+    index = index * 2 + (side == PS_UP ? 1 : 0);
+    return true;
+}
+
+/*
+    the position of an index, squares are the up general's, the down general's, then material.pieces' in order.
+    return false if two pieces are on one square.
+*/
+bool tablebase_decode(const TablebaseMaterial& material, uint64_t index, std::array<uint8_t, TABLEBASE_MAX_PIECES + 2>& squares, PieceSide& side){
+    const TablebaseIndexing& t = tablebaseIndexing;
+
+    side = (index & 1) != 0 ? PS_UP : PS_DOWN;
+    index >>= 1;
+    for (uint32_t end = material.count; end > 0; ){
+        Piece p = material.pieces[end - 1];
+        uint32_t begin = end - 1;
+        while (begin > 0 && material.pieces[begin - 1] == p){
+            --begin;
+        }
+
+        uint32_t n = end - begin;
+        uint64_t combinations = t.binomials[t.counts[p]][n];
+        uint64_t rank = index % combinations;
+        index /= combinations;
+
+        // the biggest square index first, every next one is smaller.
+        int32_t c = t.counts[p] - 1;
+        for (uint32_t j = n; j-- > 0; --c){
+            while (t.binomials[c][j + 1] > rank){
+                --c;
+            }
+
+            rank -= t.binomials[c][j + 1];
+            squares[2 + begin + j] = t.squares[p][c];
+        }
+
+        end = begin;
+    }
+
+    squares[1] = t.squares[P_DG][index % t.counts[P_DG]];
+    squares[0] = t.squares[P_UG][index / t.counts[P_DG]];
+
+    for (uint32_t i = 1; i < material.count + 2; ++i){
+        for (uint32_t j = 0; j < i; ++j){
+            if (squares[i] == squares[j]){
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+    the score of a tablebase value for the side to move at ply, like the search scores a mate.
+    a mate too far to be a mate score is kept just below SCORE_MATE_BOUND, still the quicker the better.
+*/
+inline int32_t tablebase_value_to_score(uint8_t value, int32_t ply){
+    if (value == TABLEBASE_DRAW){
+        return 0;
+    }
+
+    int32_t distance = ply + value;
+    int32_t score = distance <= MAX_SEARCH_PLY ? SCORE_MATE - distance : SCORE_MATE_BOUND - 1 - (distance - MAX_SEARCH_PLY);
+    return value % 2 == 1 ? score : -score;
+}
+
+// header of an endgame tablebase file, a directory entry of every table follows it, then the tables.
+struct TablebaseHeader{
+    char magic[8];         // TABLEBASE_MAGIC.
+    uint64_t count;        // number of tables.
+};
+
+struct TablebaseDirectoryEntry{
+    uint64_t code;         // material code.
+    uint64_t offset;       // from the beginning of the file, a table is one value of every position by its index.
+    uint64_t size;
+};
+
+static_assert(sizeof(TablebaseHeader) == 16 && sizeof(TablebaseDirectoryEntry) == 24, "tablebase records are read from the file as they are");
+
+/*
+    an endgame tablebase file mapped into memory, the pages of a table are read when the search probes them.
+    it is opened once before searching and only read after, so every searching thread probes it without locking.
+*/
+class EndgameTablebase{
+    struct Table{
+        TablebaseMaterial material;
+        const uint8_t* values;
+    };
+
+    MappedFile file;
+    std::vector<Table> tables;     // sorted by material code.
+    uint32_t maxPieces;            // pieces besides the generals of the biggest material.
+public:
+    EndgameTablebase()
+        : file{}, tables{}, maxPieces{ 0 }
+    {}
+
+    // return false if it isn't a valid tablebase file.
+    bool open(const std::string& path){
+        close();
+
+        if (!file.open(path) || file.size() < sizeof(TablebaseHeader)){
+            file.close();
+            return false;
+        }
+
+        const TablebaseHeader* header = reinterpret_cast<const TablebaseHeader*>(file.data());
+        if (std::memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->count > (file.size() - sizeof(TablebaseHeader)) / sizeof(TablebaseDirectoryEntry)){
+            file.close();
+            return false;
+        }
+
+        const TablebaseDirectoryEntry* entries = reinterpret_cast<const TablebaseDirectoryEntry*>(file.data() + sizeof(TablebaseHeader));
+        for (uint64_t i = 0; i < header->count; ++i){
+            const TablebaseDirectoryEntry& entry = entries[i];
+            Table table;
+
+            if (!tablebase_material_from_code(entry.code, table.material) || entry.size != table.material.size ||
+                entry.offset > file.size() || entry.size > file.size() - entry.offset){
+                close();
+                return false;
+            }
+
+            table.values = reinterpret_cast<const uint8_t*>(file.data() + entry.offset);
+            tables.push_back(table);
+            maxPieces = std::max(maxPieces, table.material.count);
+        }
+
+        std::sort(tables.begin(), tables.end(), [](const Table& a, const Table& b){
+            return a.material.code < b.material.code;
+        });
+        return true;
+    }
+
+    void close() noexcept {
+        file.close();
+        tables.clear();
+        maxPieces = 0;
+    }
+
+    bool is_open() const noexcept {
+        return !tables.empty();
+    }
+
+    size_t size() const noexcept {
+        return tables.size();
+    }
+
+    uint32_t get_max_pieces() const noexcept {
+        return maxPieces;
+    }
+
+    // the value of the position with side to move, false if its material is not in the tablebase.
+    bool probe(const ChessBoard& cb, PieceSide side, uint8_t& value) const {
+        if (tables.empty()){
+            return false;
+        }
+
+        uint32_t count;
+        uint64_t code = tablebase_get_code(cb, count);
+        if (count > maxPieces){
+            return false;
+        }
+
+        auto it = std::lower_bound(tables.begin(), tables.end(), code, [](const Table& table, uint64_t c){
+            return table.material.code < c;
+        });
+
+        uint64_t index;
+        if (it == tables.end() || it->material.code != code || !tablebase_encode(it->material, cb, side, index)){
+            return false;
+        }
+
+        value = it->values[index];
+        return value != TABLEBASE_ILLEGAL;
+    }
+};
+
+// opened by --tb before the game, and only probed after.
+EndgameTablebase endgameTablebase;
+
+// switches and parameters of the search, the defaults are used for playing, the benchmarks turn them off one by one.
+struct SearchConfig{
+    bool orderMoves;                  // if false, only the hash move is searched first.
+    bool usePvs;                      // principal variation search and aspiration windows, if false, full window alpha-beta.
+    bool nullMove;                    // null move pruning.
+    uint16_t nullMoveMinDepth;        // null move is only tried at this depth or deeper.
+    uint16_t nullMoveReduction;       // the null move is searched with searchDepth - 1 - nullMoveReduction.
+    int32_t nullMoveMinMaterial;      // rooks count 2, knights and cannons count 1, with less than this, zugzwang is likely.
+    bool lmr;                         // late move reductions.
+    uint16_t lmrMinDepth;             // quiet moves are only reduced at this depth or deeper.
+    uint32_t lmrMinMoveIndex;         // the first lmrMinMoveIndex moves are never reduced.
+    uint32_t lmrDeepMoveIndex;        // moves from this index are reduced by 2 instead of 1, if the depth allows.
+
+    SearchConfig()
+        : orderMoves{ true }, usePvs{ true }, nullMove{ true }, nullMoveMinDepth{ 3 }, nullMoveReduction{ 2 },
+          nullMoveMinMaterial{ 3 }, lmr{ true }, lmrMinDepth{ 3 }, lmrMinMoveIndex{ 4 }, lmrDeepMoveIndex{ 12 }
+    {}
+};
+
+// time and nodes of the search when one iteration of the iterative deepening completed.
+struct SearchDepthStats{
+    uint16_t depth;             // searchDepth of the iteration.
+    int32_t score;              // for the down side, like SearchResult.
+    uint64_t nodes;             // nodes searched since the search began.
+    double seconds;             // time since the search began.
+};
+
+/*
+    counters of a search, filled by the search as it goes. every context has its own, a parallel
+    search adds its workers' counters to the main one. cutoffs and table probes are counted by
+    negamax() only, the quiescence search just counts its nodes.
+*/
+struct SearchStats{
+    std::chrono::steady_clock::time_point begin;
+    uint64_t nodes;                    // every node, quiescence nodes included.
+    uint64_t qnodes;                   // nodes of the quiescence search.
+    uint64_t betaCutoffs;
+    uint64_t firstMoveCutoffs;         // beta cutoffs by the first searched move, the higher the ratio the better the ordering.
+    uint64_t ttProbes;
+    uint64_t ttHits;                   // probes which found the position.
+    uint64_t ttCutoffs;                // hits whose score ended the node without searching.
+    int32_t selDepth;                  // the deepest ply reached, quiescence search included.
+    uint64_t researches;               // null window or reduced searches which had to be searched again.
+    uint64_t aspirationFailHighs;      // root searches whose score was at or above the aspiration window.
+    uint64_t aspirationFailLows;       // root searches whose score was at or below the aspiration window.
+    uint64_t nullMoveCutoffs;
+    uint64_t lmrReductions;
+    uint64_t tbHits;                   // nodes scored by the endgame tablebase.
+    uint64_t repetitions;              // nodes scored as a repeated position.
+    std::vector<SearchDepthStats> depths;    // every completed iteration.
+
+    SearchStats()
+        : begin{ std::chrono::steady_clock::now() }, nodes{ 0 }, qnodes{ 0 }, betaCutoffs{ 0 }, firstMoveCutoffs{ 0 },
+          ttProbes{ 0 }, ttHits{ 0 }, ttCutoffs{ 0 }, selDepth{ 0 }, researches{ 0 }, aspirationFailHighs{ 0 },
+          aspirationFailLows{ 0 }, nullMoveCutoffs{ 0 }, lmrReductions{ 0 }, tbHits{ 0 }, repetitions{ 0 }, depths{}
+    {}
+
+    // add the counters of another search of the same position, like a worker of a parallel search.
+    void add(const SearchStats& other){
+        nodes += other.nodes;
+        qnodes += other.qnodes;
+        betaCutoffs += other.betaCutoffs;
+        firstMoveCutoffs += other.firstMoveCutoffs;
+        ttProbes += other.ttProbes;
+        ttHits += other.ttHits;
+        ttCutoffs += other.ttCutoffs;
+        selDepth = std::max(selDepth, other.selDepth);
+        researches += other.researches;
+        aspirationFailHighs += other.aspirationFailHighs;
+        aspirationFailLows += other.aspirationFailLows;
+        nullMoveCutoffs += other.nullMoveCutoffs;
+        lmrReductions += other.lmrReductions;
+        tbHits += other.tbHits;
+        repetitions += other.repetitions;
+    }
+};
+
+/*
+    states shared by every node of one search.
+    every searching thread owns a context, only the transposition table is shared.
+*/
+struct SearchContext{
+    TranspositionTable& tt;
+    std::chrono::steady_clock::time_point deadline;
+    bool timeLimited;     // if true, the search stops when deadline is reached.
+    bool stopped;         // set when the deadline is reached, every unfinished result should be discarded.
+    const std::atomic<bool>* stopSignal;   // if not null, the search stops when it becomes true.
+    uint32_t threadIndex;                  // 0 for the main thread, helper threads use it to vary their search.
+    int32_t ply;                           // distance from the root of the current node.
+    std::vector<PossibleMoves> moveStack;  // move list of every ply and one more, allocated once for the whole search.
+    SearchConfig config;
+    std::vector<std::array<MoveNode, KILLER_MOVES_PER_PLY>> killers;     // quiet moves which caused a cutoff, of every ply.
+    std::vector<int32_t> history;          // butterfly history of quiet moves, indexed by begin * BOARD_SQUARE_LEN + end.
+    uint32_t quiescenceNodesLeft;          // node budget of the current quiescence search.
+    bool nullMoveSearch;                   // set before searching a null move, so the child won't try another one.
+    SearchStats stats;
+
+    explicit SearchContext(TranspositionTable& tt)
+        : tt(tt), deadline{}, timeLimited{ false }, stopped{ false }, stopSignal{ nullptr }, threadIndex{ 0 },
+          ply{ 0 }, moveStack(MAX_SEARCH_PLY + 2), config{}, killers(MAX_SEARCH_PLY + 1),
+          history(BOARD_SQUARE_LEN * BOARD_SQUARE_LEN, 0), quiescenceNodesLeft{ 0 }, nullMoveSearch{ false }, stats{}
+    {}
+
+    void clear_move_ordering(){
+        std::fill(killers.begin(), killers.end(), std::array<MoveNode, KILLER_MOVES_PER_PLY>{});
+        std::fill(history.begin(), history.end(), 0);
+    }
+};
+
+void search_check_time(SearchContext& ctx){
+    if ((ctx.stats.nodes & (SEARCH_CHECK_TIME_NODES - 1)) != 0){
+        return;
+    }
+
+    if ((ctx.timeLimited && std::chrono::steady_clock::now() >= ctx.deadline) ||
+        (ctx.stopSignal != nullptr && ctx.stopSignal->load(std::memory_order_relaxed))){
+        ctx.stopped = true;
+    }
+}
+
+// most valuable victim first, and the least valuable attacker first for the same victim.
+inline int32_t move_calc_mvv_lva(Piece attacker, Piece victim){
+    return std::abs(piece_get_value(victim)) * 128 - std::abs(piece_get_value(attacker));
+}
+
+/*
+    yields the moves of a node in stages: the hash move, captures by MVV-LVA, the killer moves
+    of this ply, then the other quiet moves by history. the moves are generated at once, but every
+    stage only picks its best remaining move when asked, so an early cutoff skips the sorting of the rest.
+*/
+class MovePicker{
+    enum Stage{
+        MPS_HASH,
+        MPS_CAPTURES,
+        MPS_KILLERS,
+        MPS_QUIETS,
+        MPS_UNORDERED,      // the generated order, when ordering is turned off.
+        MPS_DONE
+    };
+
+    PossibleMoves& moves;
+    std::array<int32_t, MAX_ONE_SIDE_POSSIBLE_MOVES_LEN> scores;
+    const std::array<MoveNode, KILLER_MOVES_PER_PLY>& killers;
+    MoveNode hashMove;
+    size_t current;         // moves before it are yielded.
+    size_t capturesEnd;     // captures are in [0, capturesEnd), quiet moves are behind.
+    size_t killerIndex;
+    bool ordered;
+    bool capturesOnly;
+    bool sortQuiets;        // the children of a depth 1 node are leaves, sorting its quiet moves costs more than it saves.
+    Stage stage;
+
+    // swap the best scored move in [current, end) to current and yield it.
+    MoveNode pick_best(size_t end){
+        size_t best = current;
+        for (size_t i = current + 1; i < end; ++i){
+            if (scores[i] > scores[best]){
+                best = i;
+            }
+        }
+
+        std::swap(moves[current], moves[best]);
+        std::swap(scores[current], scores[best]);
+        return moves[current++];
+    }
+public:
+    // if capturesOnly, only the captures are yielded, they are always ordered.
+    MovePicker(const ChessBoard& cb, SearchContext& ctx, PossibleMoves& moves, const MoveNode& hashMove, uint16_t searchDepth, bool capturesOnly = false)
+        : moves{ moves }, killers{ ctx.killers[ctx.ply] }, hashMove{ hashMove }, current{ 0 }, capturesEnd{ 0 }, killerIndex{ 0 },
+          ordered{ ctx.config.orderMoves || capturesOnly }, capturesOnly{ capturesOnly }, sortQuiets{ ctx.config.orderMoves && !capturesOnly && searchDepth > 1 },
+          stage{ MPS_HASH }
+    {
+        if (std::find(moves.begin(), moves.end(), hashMove) == moves.end()){
+            this->hashMove = MoveNode{};
+        }
+
+        if (!ordered){
+            return;
+        }
+
+        // captures to the front.
+        for (size_t i = 0; i < moves.size(); ++i){
+            if (cb.get(moves[i].end()) != P_EE){
+                std::swap(moves[i], moves[capturesEnd]);
+                scores[capturesEnd] = move_calc_mvv_lva(cb.get(moves[capturesEnd].begin()), cb.get(moves[capturesEnd].end()));
+                ++capturesEnd;
+            }
+        }
+
+        for (size_t i = capturesEnd; sortQuiets && i < moves.size(); ++i){
+            scores[i] = ctx.history[moves[i].begin() * BOARD_SQUARE_LEN + moves[i].end()];
+        }
+    }
+
+    // if the last move from next() is an ordinary quiet move, not the hash move or a killer.
+    bool is_late_quiet() const noexcept {
+        return stage == MPS_QUIETS;
+    }
+
+    // get the next move, return false if there's no more.
+    bool next(MoveNode& move){
+        switch (stage)
+        {
+        case MPS_HASH:
+            stage = ordered ? MPS_CAPTURES : MPS_UNORDERED;
+            if (hashMove != MoveNode{}){
+                move = hashMove;
+                return true;
+            }
+            return next(move);
+        case MPS_CAPTURES:
+            while (current < capturesEnd){
+                move = pick_best(capturesEnd);
+                if (move != hashMove){
+                    return true;
+                }
+            }
+            if (capturesOnly){
+                stage = MPS_DONE;
+                return false;
+            }
+            stage = MPS_KILLERS;
+            return next(move);
+        case MPS_KILLERS:
+            while (killerIndex < KILLER_MOVES_PER_PLY){
+                move = killers[killerIndex++];
+                if (move == MoveNode{} || move == hashMove){
+                    continue;
+                }
+
+                // a killer is only searched if it is a quiet move of this node, it is taken out of the quiet moves.
+                auto it = std::find(moves.begin() + current, moves.end(), move);
+                if (it != moves.end()){
+                    size_t i = it - moves.begin();
+                    std::swap(moves[current], moves[i]);
+                    std::swap(scores[current], scores[i]);
+                    ++current;
+                    return true;
+                }
+            }
+            stage = MPS_QUIETS;
+            return next(move);
+        case MPS_QUIETS:
+            while (current < moves.size()){
+                move = sortQuiets ? pick_best(moves.size()) : moves[current++];
+                if (move != hashMove){
+                    return true;
+                }
+            }
+            stage = MPS_DONE;
+            return false;
+        case MPS_UNORDERED:
+            while (current < moves.size()){
+                move = moves[current++];
+                if (move != hashMove){
+                    return true;
+                }
+            }
+            stage = MPS_DONE;
+            return false;
+        case MPS_DONE:
+        default:
+            return false;
+        }
+    }
+};
+
+// a quiet move caused a cutoff, remember it as a killer of this ply and raise its history.
+void search_update_move_ordering(const ChessBoard& cb, SearchContext& ctx, const MoveNode& move, uint16_t searchDepth){
+    if (cb.get(move.end()) != P_EE){
+        return;
+    }
+
+    std::array<MoveNode, KILLER_MOVES_PER_PLY>& killers = ctx.killers[ctx.ply];
+    if (killers[0] != move){
+        std::copy_backward(killers.begin(), killers.end() - 1, killers.end());
+        killers[0] = move;
+    }
+
+    int32_t& value = ctx.history[move.begin() * BOARD_SQUARE_LEN + move.end()];
+    value += searchDepth * searchDepth;
+
+    if (value >= MOVE_HISTORY_MAX){
+        for (int32_t& h : ctx.history){
+            h /= 2;
+        }
+    }
+}
+
+/*
+    quiescence search, only searches captures until the position is quiet, so the static score
+    is never taken in the middle of an exchange. the side to move can stand pat(stop capturing) unless
+    it is in check, then every evasion is searched and having none is a mate.
+    ctx.quiescenceNodesLeft limits its size, the rest of it only takes the static score.
+    the score is for Side, like negamax().
+*/
+template <PieceSide Side>
+int32_t quiescence(ChessBoard& cb, SearchContext& ctx, int32_t alpha, int32_t beta){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    ++ctx.stats.nodes;
+    ++ctx.stats.qnodes;
+    ctx.stats.selDepth = std::max(ctx.stats.selDepth, ctx.ply);
+    search_check_time(ctx);
+    if (ctx.stopped){
+        return 0;
+    }
+
+    int32_t standPat = score_for_side(board_calc_score(cb), Side);
+    if (ctx.quiescenceNodesLeft == 0 || ctx.ply >= MAX_SEARCH_PLY){
+        return standPat;
+    }
+    --ctx.quiescenceNodesLeft;
+
+    int32_t general = cb.get_general_square(Side);
+    bool inCheck = is_in_check<Side>(cb);
+    int32_t bestValue = -SCORE_MATE + ctx.ply;
+
+    if (!inCheck){
+        if (standPat >= beta){
+            return standPat;
+        }
+
+        bestValue = standPat;
+        alpha = std::max(alpha, standPat);
+    }
+
+    PossibleMoves& possibleMoves = ctx.moveStack[ctx.ply];
+    gen_possible_moves<Side>(cb, possibleMoves);
+
+    MovePicker picker(cb, ctx, possibleMoves, MoveNode{}, 0, !inCheck);
+    MoveNode node;
+    while (picker.next(node)) {
+        // delta pruning.
+        if (!inCheck && standPat + std::abs(piece_get_value(cb.get(node.end()))) + QUIESCENCE_DELTA_MARGIN <= alpha){
+            continue;
+        }
+
+        cb.move(node);
+        if (move_exposes_general<Side>(cb, node, general, inCheck)){
+            cb.undo();
+            continue;
+        }
+
+        ++ctx.ply;
+        int32_t value = -quiescence<ENEMY>(cb, ctx, -beta, -alpha);
+        --ctx.ply;
+        cb.undo();
+
+        bestValue = std::max(bestValue, value);
+        alpha = std::max(alpha, bestValue);
+        if (alpha >= beta){
+            break;
+        }
+    }
+
+    return bestValue;
+}
+
+// if this side has enough attacking pieces to make null move pruning safe from zugzwang.
+bool search_can_try_null_move(const ChessBoard& cb, const SearchConfig& config, PieceSide side){
+    int32_t material = 2 * cb.get_piece_count(piece_make(side, PT_ROOK)) +
+                       cb.get_piece_count(piece_make(side, PT_KNIGHT)) +
+                       cb.get_piece_count(piece_make(side, PT_CANNON));
+
+    return material >= config.nullMoveMinMaterial;
+}
+
+// how much a late move is reduced, 0 if it is searched with the full depth.
+uint16_t search_calc_reduction(const SearchConfig& config, uint16_t searchDepth, uint32_t moveIndex, bool lateQuiet, bool inCheck){
+    if (!config.lmr || !lateQuiet || inCheck || searchDepth < config.lmrMinDepth || moveIndex < config.lmrMinMoveIndex){
+        return 0;
+    }
+
+    return (moveIndex >= config.lmrDeepMoveIndex && searchDepth > config.lmrMinDepth) ? 2 : 1;
+}
+
+/*
+    negamax algorithm, with alpha-beta pruning and transposition table.
+    every score is for Side, the side to move, a child's score is negated for its parent, so both sides
+    share one kernel. Side is a template parameter, the move generator and the kernel are compiled for
+    each side without checking the side at runtime. the transposition table stores the same scores.
+    it is a principal variation search: after the first move, every move is searched with a null window
+    first to prove it is not better, only a move which fails to be proved is searched again with the full window.
+    outside the principal variation, a node may pass(null move) to prove it is good enough without searching,
+    and late quiet moves are searched shallower first, see SearchConfig.
+*/
+template <PieceSide Side>
+int32_t negamax(ChessBoard& cb, SearchContext& ctx, uint16_t searchDepth, int32_t alpha, int32_t beta){
+    constexpr PieceSide ENEMY = piece_side_get_reverse(Side);
+
+    bool afterNullMove = ctx.nullMoveSearch;
+    ctx.nullMoveSearch = false;
+
+    // a repeated position is scored by the repetition rule, the cycle is not searched again.
+    int32_t repetition;
+    if (ctx.ply > 0 && (repetition = cb.get_repetition_distance()) != 0){
+        ++ctx.stats.nodes;
+        ++ctx.stats.repetitions;
+        ctx.stats.selDepth = std::max(ctx.stats.selDepth, ctx.ply);
+        return repetition_judge(cb, repetition, Side, repetitionRule, ctx.moveStack[ctx.ply], ctx.moveStack[ctx.ply + 1]) * (SCORE_MATE - ctx.ply);
+    }
+
+    // a position in the endgame tablebase is scored exactly, however far its mate is, the subtree is never searched.
+    uint8_t tbValue;
+    if (ctx.ply > 0 && endgameTablebase.probe(cb, Side, tbValue)){
+        ++ctx.stats.nodes;
+        ++ctx.stats.tbHits;
+        ctx.stats.selDepth = std::max(ctx.stats.selDepth, ctx.ply);
+        return tablebase_value_to_score(tbValue, ctx.ply);
+    }
+
+    if (searchDepth == 0){    // the quiescence search counts this node.
+        ctx.quiescenceNodesLeft = QUIESCENCE_MAX_NODES;
+        return quiescence<Side>(cb, ctx, alpha, beta);
+    }
+
+    ++ctx.stats.nodes;
+    ctx.stats.selDepth = std::max(ctx.stats.selDepth, ctx.ply);
+    search_check_time(ctx);
+    if (ctx.stopped){
+        return 0;
+    }
+
+    uint64_t key = cb.get_key() ^ zobrist_get_side_key(Side);
+    int32_t alphaOrig = alpha;
+    int32_t betaOrig = beta;
+
+    TTEntry entry;
+    MoveNode hashMove;
+    ++ctx.stats.ttProbes;
+    if (ctx.tt.probe(key, entry)){
+        ++ctx.stats.ttHits;
+        if (entry.depth >= searchDepth){
+            int32_t score = score_from_tt(entry.score, ctx.ply);
+
+            if (entry.bound == TTB_EXACT ||
+                (entry.bound == TTB_LOWER && score >= beta) ||
+                (entry.bound == TTB_UPPER && score <= alpha)){
+                ++ctx.stats.ttCutoffs;
+                return score;
+            }
+        }
+
+        hashMove = entry.bestMove;
+    }
+
+    const SearchConfig& config = ctx.config;
+    bool inCheck = is_in_check<Side>(cb);
+    bool pvNode = beta - 1 > alpha;
+
+    // null move pruning, if this side is still good enough after passing, the node is good enough.
+    if (config.nullMove && !pvNode && !inCheck && !afterNullMove && searchDepth >= config.nullMoveMinDepth &&
+        search_can_try_null_move(cb, config, Side) && score_for_side(board_calc_score(cb), Side) >= beta){
+        uint16_t depth = searchDepth - 1 - std::min<uint16_t>(config.nullMoveReduction, searchDepth - 1);
+
+        ++ctx.ply;
+        ctx.nullMoveSearch = true;
+        cb.move_null();
+        int32_t value = -negamax<ENEMY>(cb, ctx, depth, -beta, -beta + 1);
+        cb.undo();
+        --ctx.ply;
+
+        if (value >= beta && !ctx.stopped){
+            ++ctx.stats.nullMoveCutoffs;
+            // a mate found after passing is not proven for this position, only that it's good enough.
+            return value >= SCORE_MATE_BOUND ? beta : value;
+        }
+    }
+
+    int32_t bestValue = -SEARCH_INFINITY;
+    MoveNode bestMove;
+    uint32_t moveIndex = 0;     // number of legal moves searched.
+    int32_t general = cb.get_general_square(Side);
+
+    PossibleMoves& possibleMoves = ctx.moveStack[ctx.ply];
+    gen_possible_moves<Side>(cb, possibleMoves);
+
+    MovePicker picker(cb, ctx, possibleMoves, hashMove, searchDepth);
+    MoveNode node;
+    while (picker.next(node)) {
+        bool lateQuiet = picker.is_late_quiet();
+        cb.move(node);
+        if (move_exposes_general<Side>(cb, node, general, inCheck)){
+            cb.undo();
+            continue;
+        }
+
+        ++ctx.ply;
+        int32_t value;
+        if (bestMove == MoveNode{} || !config.usePvs){
+            value = -negamax<ENEMY>(cb, ctx, searchDepth - 1, -beta, -alpha);
+        }
+        else {
+            uint16_t reduction = search_calc_reduction(config, searchDepth, moveIndex, lateQuiet, inCheck);
+            if (reduction > 0 && is_in_check<ENEMY>(cb)){    // don't reduce checks.
+                reduction = 0;
+            }
+
+            value = -negamax<ENEMY>(cb, ctx, searchDepth - 1 - reduction, -alpha - 1, -alpha);
+            if (reduction > 0){
+                ++ctx.stats.lmrReductions;
+                if (value > alpha){
+                    ++ctx.stats.researches;
+                    value = -negamax<ENEMY>(cb, ctx, searchDepth - 1, -alpha - 1, -alpha);
+                }
+            }
+
+            if (value > alpha && value < beta){
+                ++ctx.stats.researches;
+                value = -negamax<ENEMY>(cb, ctx, searchDepth - 1, -beta, -alpha);
+            }
+        }
+        --ctx.ply;
+        cb.undo();
+        ++moveIndex;
+
+        if (value > bestValue){
+            bestValue = value;
+            bestMove = node;
+        }
+
+        alpha = std::max(alpha, bestValue);
+        if (alpha >= beta){
+            ++ctx.stats.betaCutoffs;
+            ctx.stats.firstMoveCutoffs += moveIndex == 1;
+            search_update_move_ordering(cb, ctx, node, searchDepth);
+            break;
+        }
+    }
+
+    if (ctx.stopped){    // the result is incomplete, don't pollute the table.
+        return 0;
+    }
+
+    if (moveIndex == 0){    // checkmated or stalemated.
+        bestValue = -SCORE_MATE + ctx.ply;
+    }
+
+    TTBound bound = TTB_EXACT;
+    if (bestValue <= alphaOrig){
+        bound = TTB_UPPER;
+    }
+    else if (bestValue >= betaOrig){
+        bound = TTB_LOWER;
+    }
+
+    ctx.tt.store(key, searchDepth, bound, score_to_tt(bestValue, ctx.ply), bestMove);
+    return bestValue;
+}
+
+// negamax() for a side only known at runtime, the score is for side.
+int32_t negamax(ChessBoard& cb, SearchContext& ctx, uint16_t searchDepth, int32_t alpha, int32_t beta, PieceSide side){
+    if (side == PS_UP){
+        return negamax<PS_UP>(cb, ctx, searchDepth, alpha, beta);
+    }
+    else if (side == PS_DOWN){
+        return negamax<PS_DOWN>(cb, ctx, searchDepth, alpha, beta);
+    }
+
+    return 0;
+}
+
+/*
+    helper threads search the root moves in a different order, so they don't all
+    walk the same tree and fill the shared table with different positions.
+*/
+void rotate_root_moves_for_helper(PossibleMoves& pm, uint32_t threadIndex){
+    if (threadIndex != 0 && pm.size() > 2){
+        std::rotate(pm.begin() + 1, pm.begin() + 1 + threadIndex % (pm.size() - 1), pm.end());
+    }
+}
+
+// result of a root search.
+struct SearchResult{
+    MoveNode bestMove;
+    int32_t score;                   // upper side value is negative, down side is positive.
+    uint16_t depth;                  // searchDepth of the completed search.
+    std::vector<MoveNode> pv;        // principal variation, starts with bestMove.
+
+    SearchResult()
+        : bestMove{}, score{ 0 }, depth{ 0 }, pv{}
+    {}
+};
+
+// record a completed iteration of the iterative deepening in ctx.stats.
+void search_record_depth(SearchContext& ctx, const SearchResult& result){
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - ctx.stats.begin).count();
+    ctx.stats.depths.push_back(SearchDepthStats{ result.depth, result.score, ctx.stats.nodes, seconds });
+}
+
+inline double search_stats_ratio(uint64_t part, uint64_t whole){
+    return whole > 0 ? static_cast<double>(part) / whole : 0.0;
+}
+
+// time of the whole search, it ends with the last completed iteration.
+inline double search_stats_seconds(const SearchStats& stats){
+    return stats.depths.empty() ? 0.0 : stats.depths.back().seconds;
+}
+
+// print the counters of a search, then the nodes and time of every completed iteration.
+void print_search_stats(const SearchStats& stats){
+    double seconds = search_stats_seconds(stats);
+
+    std::printf("search: %llu nodes(%.1f%% quiescence), %.3f s, %.0f nodes/s, seldepth %d.\n",
+                static_cast<unsigned long long>(stats.nodes), 100.0 * search_stats_ratio(stats.qnodes, stats.nodes), seconds,
+                seconds > 0.0 ? stats.nodes / seconds : 0.0, stats.selDepth);
+    std::printf("  beta cutoffs %llu(%.1f%% by the first move), table hits %.1f%% of %llu probes, table cutoffs %llu.\n",
+                static_cast<unsigned long long>(stats.betaCutoffs), 100.0 * search_stats_ratio(stats.firstMoveCutoffs, stats.betaCutoffs),
+                100.0 * search_stats_ratio(stats.ttHits, stats.ttProbes), static_cast<unsigned long long>(stats.ttProbes),
+                static_cast<unsigned long long>(stats.ttCutoffs));
+    std::printf("  re-searches %llu, aspiration fail-high %llu, fail-low %llu, null move cutoffs %llu, lmr %llu, tablebase hits %llu, repetitions %llu.\n",
+                static_cast<unsigned long long>(stats.researches), static_cast<unsigned long long>(stats.aspirationFailHighs),
+                static_cast<unsigned long long>(stats.aspirationFailLows), static_cast<unsigned long long>(stats.nullMoveCutoffs),
+                static_cast<unsigned long long>(stats.lmrReductions), static_cast<unsigned long long>(stats.tbHits),
+                static_cast<unsigned long long>(stats.repetitions));
+
+    uint64_t lastNodes = 0;
+    double lastSeconds = 0.0;
+    for (const SearchDepthStats& depth : stats.depths){
+        std::printf("  depth %2u score %6d nodes %12llu time %8.3f s\n", depth.depth, depth.score,
+                    static_cast<unsigned long long>(depth.nodes - lastNodes), depth.seconds - lastSeconds);
+        lastNodes = depth.nodes;
+        lastSeconds = depth.seconds;
+    }
+}
+
+// the counters of a search as one line of JSON, every iteration's nodes and seconds are its own, not since the search began.
+std::string search_stats_to_json(const SearchStats& stats){
+    char buffer[1024];
+    double seconds = search_stats_seconds(stats);
+
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"nodes\":%llu,\"qnodes\":%llu,\"seconds\":%.6f,\"nps\":%.0f,\"seldepth\":%d,"
+                  "\"beta_cutoffs\":%llu,\"first_move_cutoffs\":%llu,\"first_move_cutoff_ratio\":%.4f,"
+                  "\"tt_probes\":%llu,\"tt_hits\":%llu,\"tt_hit_rate\":%.4f,\"tt_cutoffs\":%llu,"
+                  "\"researches\":%llu,\"aspiration_fail_highs\":%llu,\"aspiration_fail_lows\":%llu,"
+                  "\"null_move_cutoffs\":%llu,\"lmr_reductions\":%llu,\"tb_hits\":%llu,\"repetitions\":%llu,\"depths\":[",
+                  static_cast<unsigned long long>(stats.nodes), static_cast<unsigned long long>(stats.qnodes), seconds,
+                  seconds > 0.0 ? stats.nodes / seconds : 0.0, stats.selDepth,
+                  static_cast<unsigned long long>(stats.betaCutoffs), static_cast<unsigned long long>(stats.firstMoveCutoffs),
+                  search_stats_ratio(stats.firstMoveCutoffs, stats.betaCutoffs),
+                  static_cast<unsigned long long>(stats.ttProbes), static_cast<unsigned long long>(stats.ttHits),
+                  search_stats_ratio(stats.ttHits, stats.ttProbes), static_cast<unsigned long long>(stats.ttCutoffs),
+                  static_cast<unsigned long long>(stats.researches), static_cast<unsigned long long>(stats.aspirationFailHighs),
+                  static_cast<unsigned long long>(stats.aspirationFailLows), static_cast<unsigned long long>(stats.nullMoveCutoffs),
+                  static_cast<unsigned long long>(stats.lmrReductions), static_cast<unsigned long long>(stats.tbHits),
+                  static_cast<unsigned long long>(stats.repetitions));
+    std::string json = buffer;
+
+    const char* separator = "";
+    uint64_t lastNodes = 0;
+    double lastSeconds = 0.0;
+    for (const SearchDepthStats& depth : stats.depths){
+        std::snprintf(buffer, sizeof(buffer), "%s{\"depth\":%u,\"score\":%d,\"nodes\":%llu,\"seconds\":%.6f}",
+                      separator, depth.depth, depth.score, static_cast<unsigned long long>(depth.nodes - lastNodes),
+                      depth.seconds - lastSeconds);
+        json += buffer;
+        separator = ",";
+        lastNodes = depth.nodes;
+        lastSeconds = depth.seconds;
+    }
+
+    return json + "]}";
+}
+
+// follow the best moves in transposition table to get the principal variation.
+void collect_pv(ChessBoard& cb, TranspositionTable& tt, PieceSide side, std::vector<MoveNode>& pv, size_t maxLen){
+    TTEntry entry;
+    size_t played = 0;
+
+    while (pv.size() < maxLen && tt.probe(cb.get_key() ^ zobrist_get_side_key(side), entry)){
+        PossibleMoves pm = gen_legal_moves(cb, side);
+        if (std::find(pm.cbegin(), pm.cend(), entry.bestMove) == pm.cend()){
+            break;
+        }
+
+        pv.push_back(entry.bestMove);
+        cb.move(entry.bestMove);
+        ++played;
+        side = piece_side_get_reverse(side);
+    }
+
+    while (played-- > 0){
+        cb.undo();
+    }
+}
+
+/*
+    run fn(workerIndex, taskIndex) for every task in [0, taskCount) on threadCount threads.
+    tasks are dealt to the workers' own queues round-robin, a worker takes tasks from the front
+    of its own queue, and steals from the back of the others' queues when its own is empty.
+    worker 0 is the calling thread.
+*/
+void parallel_for_work_stealing(size_t taskCount, uint32_t threadCount, const std::function<void(uint32_t, size_t)>& fn){
+    struct WorkerQueue{
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<WorkerQueue> queues(threadCount);
+    for (size_t task = 0; task < taskCount; ++task){
+        queues[task % threadCount].tasks.push_back(task);
+    }
+
+    auto take_task = [&queues, threadCount](uint32_t worker, size_t& task){
+        for (uint32_t i = 0; i < threadCount; ++i){
+            WorkerQueue& q = queues[(worker + i) % threadCount];
+            std::lock_guard<std::mutex> lock(q.mutex);
+
+            if (!q.tasks.empty()){
+                if (i == 0){
+                    task = q.tasks.front();
+                    q.tasks.pop_front();
+                }
+                else {
+                    task = q.tasks.back();
+                    q.tasks.pop_back();
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    auto work = [&fn, &take_task](uint32_t worker){
+        size_t task;
+        while (take_task(worker, task)){
+            fn(worker, task);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t worker = 1; worker < threadCount; ++worker){
+        threads.emplace_back(work, worker);
+    }
+
+    work(0);
+    for (std::thread& t : threads){
+        t.join();
+    }
+}
+
+/*
+    search one root move for search_root(), with a full window if it is the first one,
+    otherwise with a null window which is widened only if the move may be better.
+    the window and the result are for the side to move at the root, like negamax().
+*/
+int32_t search_root_move(ChessBoard& cb, SearchContext& ctx, const MoveNode& node, uint16_t searchDepth,
+                         int32_t alpha, int32_t beta, PieceSide enemySide, bool first){
+    cb.move(node);
+    ++ctx.ply;
+    int32_t value;
+    if (first || !ctx.config.usePvs){
+        value = -negamax(cb, ctx, searchDepth, -beta, -alpha, enemySide);
+    }
+    else {
+        value = -negamax(cb, ctx, searchDepth, -alpha - 1, -alpha, enemySide);
+        if (value > alpha && value < beta){
+            ++ctx.stats.researches;
+            value = -negamax(cb, ctx, searchDepth, -beta, -alpha, enemySide);
+        }
+    }
+    --ctx.ply;
+    cb.undo();
+
+    return value;
+}
+
+/*
+    alpha-beta search on every move of the root.
+    the window is narrowed by the best score found so far, so later moves are only
+    proved to be not better, which is much cheaper than getting their exact scores.
+    previousBest is searched first, pass the result of a shallower search here to speed up.
+    the window and the result's score are for the down side, like board_calc_score().
+    if the score is not inside (alpha, beta), it is only a bound, see search_root_aspiration().
+    if ctx is stopped during the search, the result is incomplete and should be discarded.
+*/
+SearchResult search_root(ChessBoard& cb, SearchContext& ctx, PieceSide side, uint16_t searchDepth, const MoveNode& previousBest,
+                         int32_t alpha = -SEARCH_INFINITY, int32_t beta = SEARCH_INFINITY){
+    SearchResult result;
+    result.depth = searchDepth;
+
+    if (side != PS_UP && side != PS_DOWN){
+        return result;
+    }
+
+    // search with the window of side, like negamax().
+    if (side == PS_UP){
+        int32_t upAlpha = -beta;
+        beta = -alpha;
+        alpha = upAlpha;
+    }
+
+    PieceSide enemySide = piece_side_get_reverse(side);
+    int32_t alphaOrig = alpha;
+    int32_t betaOrig = beta;
+    int32_t bestValue = alpha;
+
+    PossibleMoves possibleMoves = gen_legal_moves(cb, side);
+    if (possibleMoves.empty()){    // checkmated or stalemated, there's no best move.
+        result.score = score_for_side(-SCORE_MATE, side);
+        return result;
+    }
+
+    put_hash_move_first(possibleMoves, previousBest);
+    rotate_root_moves_for_helper(possibleMoves, ctx.threadIndex);
+
+    for (const MoveNode& node : possibleMoves){
+        int32_t value = search_root_move(cb, ctx, node, searchDepth, alpha, beta, enemySide, result.bestMove == MoveNode{});
+
+        if (ctx.stopped){
+            break;
+        }
+
+        if (value > bestValue || result.bestMove == MoveNode{}){
+            bestValue = value;
+            result.bestMove = node;
+            alpha = std::max(alpha, value);
+        }
+
+        // fail high, the aspiration window is widened and searched again.
+        if (alpha >= beta){
+            break;
+        }
+    }
+
+    result.score = score_for_side(bestValue, side);
+
+    if (!ctx.stopped && result.bestMove != MoveNode{}){
+        TTBound bound = TTB_EXACT;
+        if (bestValue <= alphaOrig){
+            bound = TTB_UPPER;
+        }
+        else if (bestValue >= betaOrig){
+            bound = TTB_LOWER;
+        }
+
+        uint64_t key = cb.get_key() ^ zobrist_get_side_key(side);
+        ctx.tt.store(key, searchDepth + 1, bound, score_to_tt(bestValue, ctx.ply), result.bestMove);
+
+        result.pv.push_back(result.bestMove);
+        cb.move(result.bestMove);
+        collect_pv(cb, ctx.tt, enemySide, result.pv, searchDepth + 1);
+        cb.undo();
+    }
+
+    return result;
+}
+
+/*
+    search the root within a window around the previous iteration's score, a narrow window cuts more.
+    if the score falls out of the window, the window is widened on that side and the root is searched again.
+    the first iteration(previous.bestMove is empty) and ctx.config.usePvs == false use the full window.
+*/
+SearchResult search_root_aspiration(ChessBoard& cb, SearchContext& ctx, PieceSide side, uint16_t searchDepth, const SearchResult& previous){
+    constexpr int32_t INF_MIN = -SEARCH_INFINITY;
+    constexpr int32_t INF_MAX = SEARCH_INFINITY;
+
+    if (previous.bestMove == MoveNode{} || !ctx.config.usePvs){
+        SearchResult result = search_root(cb, ctx, side, searchDepth, previous.bestMove);
+        if (!ctx.stopped){
+            search_record_depth(ctx, result);
+        }
+
+        return result;
+    }
+
+    int32_t lowDelta = ASPIRATION_WINDOW;
+    int32_t highDelta = ASPIRATION_WINDOW;
+
+    while (true){
+        int32_t alpha = previous.score - lowDelta;
+        int32_t beta = previous.score + highDelta;
+        if (lowDelta >= ASPIRATION_WINDOW << 8){     // too many fails, give up this side.
+            alpha = INF_MIN;
+        }
+        if (highDelta >= ASPIRATION_WINDOW << 8){
+            beta = INF_MAX;
+        }
+
+        SearchResult result = search_root(cb, ctx, side, searchDepth, previous.bestMove, alpha, beta);
+        if (ctx.stopped){
+            return result;
+        }
+
+        if (result.score <= alpha && alpha != INF_MIN){
+            ++ctx.stats.aspirationFailLows;
+            lowDelta *= 2;
+        }
+        else if (result.score >= beta && beta != INF_MAX){
+            ++ctx.stats.aspirationFailHighs;
+            highDelta *= 2;
+        }
+        else {
+            search_record_depth(ctx, result);
+            return result;
+        }
+    }
+}
+
+/*
+    deepen from 0 to searchDepth, every iteration gives the next one its best move and aspiration window.
+    if timeLimitMs is not 0, no new iteration starts after timeLimitMs milliseconds from the beginning of the search,
+    and the iterations after the first one stop when time is up, so there is always a move even if timeLimitMs is tiny.
+    onIteration, if not empty, is called with the result of every completed iteration.
+    if ctx is stopped, the result of the deepest completed iteration is returned.
+*/
+SearchResult search_iterative_deepening(ChessBoard& cb, SearchContext& ctx, PieceSide side, uint16_t searchDepth, uint32_t timeLimitMs = 0,
+                                        const std::function<void(const SearchResult&)>& onIteration = nullptr){
+    ctx.deadline = ctx.stats.begin + std::chrono::milliseconds(timeLimitMs);
+
+    SearchResult result;
+    for (uint16_t depth = 0; depth <= searchDepth; ++depth){
+        SearchResult next = search_root_aspiration(cb, ctx, side, depth, result);
+
+        if (ctx.stopped){
+            break;
+        }
+
+        result = next;
+        ctx.timeLimited = timeLimitMs > 0;
+        if (onIteration){
+            onIteration(result);
+        }
+
+        // no move at the root, deeper iterations won't find one either.
+        if (result.pv.empty() || (ctx.timeLimited && std::chrono::steady_clock::now() >= ctx.deadline)){
+            break;
+        }
+    }
+
+    return result;
+}
+
+/*
+    lazy smp search, threadCount threads search the same root and share the transposition table.
+    the main thread deepens from 0 to searchDepth, helper threads keep deepening with a slightly
+    different depth and root move order until the main thread finishes, their results are only
+    useful through the table, so the returned result is always the main thread's.
+    stats gets the main thread's iterations and the counters of every thread.
+    if stopSignal is not null and becomes true, the main thread stops and returns its deepest completed iteration.
+    timeLimitMs limits the main thread's iterative deepening like search_iterative_deepening(), 0 for no limit.
+*/
+SearchResult search_lazy_smp(ChessBoard& cb, TranspositionTable& tt, PieceSide side, uint16_t searchDepth, uint32_t threadCount,
+                             uint64_t* totalNodes = nullptr, SearchStats* stats = nullptr,
+                             const std::atomic<bool>* externalStopSignal = nullptr, uint32_t timeLimitMs = 0){
+    std::atomic<bool> stopSignal{ false };
+    std::vector<std::thread> helpers;
+    std::vector<SearchStats> helperStats(threadCount);
+
+    // copied before any thread starts, the main thread changes cb while it searches.
+    std::vector<ChessBoard> helperBoards(threadCount, cb);
+
+    for (uint32_t i = 1; i < threadCount; ++i){
+        helpers.emplace_back([&helperBoards, &tt, &stopSignal, &helperStats, side, i](){
+            ChessBoard& helperBoard = helperBoards[i];
+            SearchContext ctx{ tt };
+            ctx.stopSignal = &stopSignal;
+            ctx.threadIndex = i;
+
+            SearchResult previous;
+            for (uint16_t depth = i % 2; depth <= MAX_SEARCH_DEPTH && !ctx.stopped; ++depth){
+                SearchResult result = search_root_aspiration(helperBoard, ctx, side, depth, previous);
+
+                if (!ctx.stopped){
+                    previous = result;
+                }
+            }
+
+            helperStats[i] = ctx.stats;
+        });
+    }
+
+    SearchContext ctx{ tt };
+    ctx.stopSignal = externalStopSignal;
+
+    SearchResult result = search_iterative_deepening(cb, ctx, side, searchDepth, timeLimitMs);
+
+    stopSignal.store(true, std::memory_order_relaxed);
+    for (std::thread& t : helpers){
+        t.join();
+    }
+
+    for (const SearchStats& helper : helperStats){
+        ctx.stats.add(helper);
+    }
+
+    if (totalNodes != nullptr){
+        *totalNodes = ctx.stats.nodes;
+    }
+
+    if (stats != nullptr){
+        *stats = ctx.stats;
+    }
+
+    return result;
+}
+
+// what to show about the AI's search after every AI move.
+enum StatsMode{
+    SM_NONE,
+    SM_TEXT,            // print_search_stats().
+    SM_JSON             // one line of search_stats_to_json().
+};
+
+/* 
+    gen best move for one side. 
+    searchDepth is used as difficulty rank, the bigger it is, the more time the generation costs.
+    it deepens from 0 to searchDepth, every iteration gives the next one its best move and aspiration window.
+    if threadCount is bigger than 1, the search runs in parallel by lazy smp.
+    if stats is not null, it gets the statistics of the search.
+    if stopSignal is not null and becomes true, the search stops and returns the move of its deepest completed iteration.
+    if timeLimitMs is not 0, no iteration starts after timeLimitMs milliseconds, and an iteration after the first one
+    is stopped when time is up, the move of the deepest completed iteration is returned.
+    give param enum PieceSide: PS_EXTRA to this function is meaningless, you will always get an empty MoveNode.
+*/
+MoveNode gen_best_move(ChessBoard& cb, TranspositionTable& tt, PieceSide side, uint16_t searchDepth, uint32_t threadCount = 1,
+                       SearchStats* stats = nullptr,
+                       const std::atomic<bool>* stopSignal = nullptr, uint32_t timeLimitMs = 0){
+    if (threadCount > 1){
+        return search_lazy_smp(cb, tt, side, searchDepth, threadCount, nullptr, stats, stopSignal, timeLimitMs).bestMove;
+    }
+
+    SearchContext ctx{ tt };
+    ctx.stopSignal = stopSignal;
+
+    SearchResult result = search_iterative_deepening(cb, ctx, side, searchDepth, timeLimitMs);
+
+    if (stats != nullptr){
+        *stats = ctx.stats;
+    }
+
+    return result.bestMove;
+}
+
+// given move is fit for rule ? return false if not, a move which leaves its own general attacked is not.
+bool check_rule(const ChessBoard& cb, const MoveNode& moveNode){
+    Piece p = cb.get(moveNode.begin());
+    ChessBoard board{ cb };
+    PossibleMoves pm = gen_legal_moves(board, piece_get_side(p));
+
+    return std::find(pm.cbegin(), pm.cend(), moveNode) != pm.cend();
+}
+
+// user input could represent a move ? return false if can't.
+bool check_input_is_a_move(const std::string& input){
+    if (input.size() < 4){
+        return false;
+    }
+
+    return  (input[0] >= 'a' && input[0] <= 'i') &&
+            (input[1] >= '0' && input[1] <= '9') &&
+            (input[2] >= 'a' && input[2] <= 'i') &&
+            (input[3] >= '0' && input[3] <= '9');
+}
+
+/*
+    convert user input to a struct MoveNode object.
+    you should call check_input_is_a_move() before to make sure this converting is valid.
+*/
+MoveNode convert_input_to_move(const std::string& input){
+    int32_t beginRow = 9 - (static_cast<int32_t>(input[1]) - static_cast<int32_t>('0')) + BOARD_ACTUAL_ROW_BEGIN;
+    int32_t beginCol = static_cast<int32_t>(input[0]) - static_cast<int32_t>('a') + BOARD_ACTUAL_COL_BEGIN;
+    int32_t endRow   = 9 - (static_cast<int32_t>(input[3]) - static_cast<int32_t>('0')) + BOARD_ACTUAL_ROW_BEGIN;
+    int32_t endCol   = static_cast<int32_t>(input[2]) - static_cast<int32_t>('a') + BOARD_ACTUAL_COL_BEGIN;
+
+    return MoveNode(square_make(beginRow, beginCol), square_make(endRow, endCol));
+}
+
+// convert a move to string.
+std::string convert_move_to_str(const MoveNode& move){
+    std::string buf;
+
+    buf += static_cast<char>(move.begin_col() - BOARD_ACTUAL_COL_BEGIN + 'a');
+    buf += static_cast<char>(9 - (move.begin_row() - BOARD_ACTUAL_ROW_BEGIN) + '0');
+    buf += static_cast<char>(move.end_col() - BOARD_ACTUAL_COL_BEGIN + 'a');
+    buf += static_cast<char>(9 - (move.end_row() - BOARD_ACTUAL_ROW_BEGIN) + '0');
+    return buf;
+}
+
+// every one can only move his pieces, not the enemy's.
+bool check_is_this_your_piece(const ChessBoard& cb, const MoveNode& move, PieceSide side){
+    Piece p = cb.get(move.begin());
+    return piece_get_side(p) == side;
+}
+
+// sideToMove loses if it has no legal move, checkmated or stalemated. if no one wins, return PS_EXTRA.
+PieceSide check_winner(const ChessBoard& cb, PieceSide sideToMove){
+    bool upAlive = cb.get_piece_count(P_UG) > 0;
+    bool downAlive = cb.get_piece_count(P_DG) > 0;
+
+    if (upAlive && downAlive) {
+        ChessBoard board{ cb };
+        return gen_legal_moves(board, sideToMove).empty() ? piece_side_get_reverse(sideToMove) : PS_EXTRA;
+    }
+    else if (upAlive) {
+        return PS_UP;
+    }
+    else {
+        return PS_DOWN;
+    }
+}
+
+// the game ends when a position is on the chess board for the third time, winner is judged by repetitionRule, PS_EXTRA for a draw.
+bool check_repetition_end(ChessBoard& cb, PieceSide sideToMove, PieceSide& winner){
+    if (cb.get_repetition_count() < 2){
+        return false;
+    }
+
+    PossibleMoves captures;
+    PossibleMoves replies;
+    int32_t verdict = repetition_judge(cb, cb.get_repetition_distance(), sideToMove, repetitionRule, captures, replies);
+    winner = verdict == 0 ? PS_EXTRA : (verdict > 0 ? sideToMove : piece_side_get_reverse(sideToMove));
+    return true;
+}
+
+// header of an opening book file, the records follow it.
+struct BookHeader{
+    char magic[8];         // BOOK_MAGIC.
+    uint64_t startKey;     // key of the start position with the down side to move, zobrist keys of the builder.
+    uint64_t count;        // number of records.
+};
+
+// one move of a position in an opening book.
+struct BookEntry{
+    uint64_t key;          // zobrist key of the position with the side to move, like the transposition table's.
+    uint32_t weight;       // how many games played the move, moves are picked in proportion to it.
+    uint16_t move;         // MoveNode::value.
+    uint16_t reserved;
+};
+
+static_assert(sizeof(BookHeader) == 24 && sizeof(BookEntry) == 16, "book records are read from the file as they are");
+
+inline uint64_t book_get_key(const ChessBoard& cb, PieceSide side){
+    return cb.get_key() ^ zobrist_get_side_key(side);
+}
+
+/*
+    opening book, a BookHeader and BookEntry records sorted by key, then by move.
+    the file is memory-mapped, so opening it costs nothing however big it is, and find() binary
+    searches the records in place. records are in the byte order of the machine which built
+    the book, and a book built with other zobrist keys is refused by the start position's key.
+*/
+class OpeningBook{
+    MappedFile file;
+    const BookEntry* entries;
+    size_t count;
+public:
+    OpeningBook()
+        : file{}, entries{ nullptr }, count{ 0 }
+    {}
+
+    // map the book file, return false if it can't be mapped or it is not a valid book.
+    bool open(const std::string& path){
+        close();
+        if (!file.open(path) || file.size() < sizeof(BookHeader)){
+            close();
+            return false;
+        }
+
+        const BookHeader* header = reinterpret_cast<const BookHeader*>(file.data());
+        if (std::memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) != 0 ||
+            header->startKey != book_get_key(ChessBoard{}, PS_DOWN) ||
+            header->count != (file.size() - sizeof(BookHeader)) / sizeof(BookEntry)){
+            close();
+            return false;
+        }
+
+        entries = reinterpret_cast<const BookEntry*>(file.data() + sizeof(BookHeader));
+        count = static_cast<size_t>(header->count);
+        return true;
+    }
+
+    void close() noexcept {
+        file.close();
+        entries = nullptr;
+        count = 0;
+    }
+
+    bool is_open() const noexcept {
+        return file.is_open();
+    }
+
+    size_t size() const noexcept {
+        return count;
+    }
+
+    // the records of a position, [first, second) is empty if it is not in the book.
+    std::pair<const BookEntry*, const BookEntry*> find(uint64_t key) const noexcept {
+        return find_records_by_key(entries, count, key);
+    }
+};
+
+/*
+    pick a book move of side from the position, in proportion to the weights of its legal moves.
+    return false if the position is not in the book(or the book isn't open), then search as usual.
+*/
+bool book_probe(const OpeningBook& book, const ChessBoard& cb, PieceSide side, MoveNode& move){
+    if (!book.is_open()){
+        return false;
+    }
+
+    auto range = book.find(book_get_key(cb, side));
+    std::vector<std::pair<MoveNode, uint32_t>> candidates;
+    uint64_t totalWeight = 0;
+
+    for (const BookEntry* entry = range.first; entry != range.second; ++entry){
+        MoveNode candidate;
+        candidate.value = entry->move;
+
+        // a different position with the same key would give a move which is not legal here.
+        if (entry->weight > 0 && square_is_on_board(candidate.begin()) && square_is_on_board(candidate.end()) &&
+            check_is_this_your_piece(cb, candidate, side) && check_rule(cb, candidate)){
+            candidates.emplace_back(candidate, entry->weight);
+            totalWeight += entry->weight;
+        }
+    }
+
+    if (candidates.empty()){
+        return false;
+    }
+
+    static std::mt19937_64 generator{ std::random_device{}() };
+    uint64_t pick = std::uniform_int_distribution<uint64_t>(0, totalWeight - 1)(generator);
+    for (const auto& candidate : candidates){
+        if (pick < candidate.second){
+            move = candidate.first;
+            break;
+        }
+
+        pick -= candidate.second;
+    }
+
+    return true;
+}
+
+class ConsoleColor {
+    #ifdef _WIN32
+    HANDLE hOutHandle;
+    WORD oldColorAttrs;
+
+    // https://stackoverflow.com/questions/17125440/c-win32-console-color
+    WORD get_windows_color_attr(int color) {
+        switch(color) {
+            case Black: 
+                return 0;
+            case Blue: 
+                return FOREGROUND_BLUE;
+            case Green: 
+                return FOREGROUND_GREEN;
+            case Cyan: 
+                return FOREGROUND_GREEN | FOREGROUND_BLUE;
+            case Red: 
+                return FOREGROUND_RED;
+            case Magenta: 
+                return FOREGROUND_RED | FOREGROUND_BLUE;
+            case Yellow: 
+                return FOREGROUND_RED | FOREGROUND_GREEN;
+            case White:
+                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+            case BoldBlack: 
+                return 0 | FOREGROUND_INTENSITY;
+            case BoldBlue: 
+                return FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+            case BoldGreen: 
+                return FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+            case BoldCyan: 
+                return FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+            case BoldRed: 
+                return FOREGROUND_RED | FOREGROUND_INTENSITY;
+            case BoldMagenta: 
+                return FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+            case BoldYellow: 
+                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+            case BoldWhite:
+            default:
+                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+        };
+    }
+    #endif
+public:
+    enum {
+        Black, 
+        Red, 
+        Green, 
+        Yellow, 
+        Blue, 
+        Magenta, 
+        Cyan, 
+        White,
+        BoldBlack, 
+        BoldRed, 
+        BoldGreen, 
+        BoldYellow, 
+        BoldBlue, 
+        BoldMagenta, 
+        BoldCyan, 
+        BoldWhite
+    };
+
+    ConsoleColor() {
     #ifdef _WIN32
-    HANDLE hOutHandle;
-    WORD oldColorAttrs;
+        CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
+    hOutHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+    GetConsoleScreenBufferInfo(hOutHandle, &csbiInfo);
+    oldColorAttrs = csbiInfo.wAttributes;
+    #endif
+    }
+
+    ~ConsoleColor() noexcept {
+        reset();
+    }
+
+    void set(int color) noexcept {
+        #if defined(__linux__) || defined(__Free_BSD__)
+        switch(color) {
+            case Black:
+                std::cout << "\033[30m"; break;
+            case Red:
+                std::cout << "\033[31m"; break;
+            case Green:
+                std::cout << "\033[32m"; break;
+            case Yellow:       
+                std::cout << "\033[33m"; break;
+            case Blue:         
+                std::cout << "\033[34m"; break;
+            case Magenta:      
+                std::cout << "\033[35m"; break;
+            case Cyan:         
+                std::cout << "\033[36m"; break;
+            case White:        
+                std::cout << "\033[37m"; break;
+            case BoldBlack:    
+                std::cout << "\033[1m\033[30m"; break;
+            case BoldRed:      
+                std::cout << "\033[1m\033[31m"; break;
+            case BoldGreen:    
+                std::cout << "\033[1m\033[32m"; break;
+            case BoldYellow:   
+                std::cout << "\033[1m\033[33m"; break;
+            case BoldBlue:     
+                std::cout << "\033[1m\033[34m"; break;
+            case BoldMagenta:  
+                std::cout << "\033[1m\033[35m"; break;
+            case BoldCyan:     
+                std::cout << "\033[1m\033[36m"; break;
+            case BoldWhite:  
+            default:  
+                std::cout << "\033[1m\033[37m"; break;
+        }
+        #elif defined(_WIN32)
+        SetConsoleTextAttribute(hOutHandle, get_windows_color_attr(color));
+        #endif
+    }
+
+    void reset() noexcept {
+        #if defined(__linux__) || defined(__Free_BSD__)
+        std::cout << "\033[0m";
+        #elif defined(_WIN32)
+        SetConsoleTextAttribute(hOutHandle, oldColorAttrs);
+        #endif
+    }
+};
+
+void draw_board(const ChessBoard& cb){
+    ConsoleColor cc;
+    int n = BOARD_ROW_LEN - 1;
+
+    std::cout << "\n    +-------------------+\n";
+
+    int r, c;
+    for (r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r) {
+        if (r == BOARD_CHU_HAN_LINE){
+            std::cout << "    |===================|\n";
+            std::cout << "    |===================|\n";
+        }
+
+        cc.set(ConsoleColor::Yellow);
+        std::cout << " " << n--;
+        cc.reset();
+
+        std::cout << "  | ";
+
+        for (c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c){
+            Piece p = cb.get(r, c);
+
+            if (piece_get_side(p) == PS_UP) {
+                cc.set(ConsoleColor::BoldBlue);
+            }
+            else if (piece_get_side(p) == PS_DOWN) {
+                cc.set(ConsoleColor::BoldRed);
+            }
+            else {
+                cc.set(ConsoleColor::White);
+            }
+
+            std::cout << piece_get_char(p) << " ";
+            cc.reset();
+        }
+
+        std::cout << "|\n";
+    }
+
+    std::cout << "    +-------------------+\n";
+
+    cc.set(ConsoleColor::BoldGreen);
+    std::cout << "\n      a b c d e f g h i\n\n";
+    cc.reset();
+}
+
+void print_help_page(){
+    std::cout << "\n=======================================\n";
+    std::cout << "Help Page\n\n";
+    std::cout << "    1. help         - this page.\n";
+    std::cout << "    2. b2e2         - input like this will be parsed as a move.\n";
+    std::cout << "    3. undo         - undo the previous move.\n";
+    std::cout << "    4. exit or quit - exit the game.\n";
+    std::cout << "    5. remake       - remake the game.\n";
+    std::cout << "    6. diff         - change the AI difficulty.\n";
+    std::cout << "    7. advice       - give me a best move.\n\n";
+    std::cout << "  The characters on the board have the following relationships: \n\n";
+    std::cout << "    P -> AI side pawn.\n";
+    std::cout << "    C -> AI side cannon.\n";
+    std::cout << "    R -> AI side rook.\n";
+    std::cout << "    N -> AI side knight.\n";
+    std::cout << "    B -> AI side bishop.\n";
+    std::cout << "    A -> AI side advisor.\n";
+    std::cout << "    G -> AI side general.\n";
+    std::cout << "    p -> our pawn.\n";
+    std::cout << "    c -> our cannon.\n";
+    std::cout << "    r -> our rook.\n";
+    std::cout << "    n -> our knight.\n";
+    std::cout << "    b -> our bishop.\n";
+    std::cout << "    a -> our advisor.\n";
+    std::cout << "    g -> our general.\n";
+    std::cout << "    . -> no piece here.\n";
+    std::cout << "=======================================\n";
+    std::cout << "Press any key to continue.\n";
+
+    // ignore any input.    
+    std::string line;
+    std::getline(std::cin, line);
+}
+
+void state_help(ChessBoard const& cb) {
+    print_help_page();
+    draw_board(cb);
+}
+
+void state_undo(ChessBoard& cb) {
+    cb.undo();
+    cb.undo();
+    draw_board(cb);
+}
+
+void state_remake(ChessBoard& cb) {
+    cb.clear();
+    std::cout << "New cnchess started.\n";
+    draw_board(cb);
+}
+
+void state_diff(uint16_t& searchDepth) {
+    std::string input;
+    std::cout << "Current difficulty is " << searchDepth << ", want to change it(y/n)? ";
+    
+    std::getline(std::cin, input);
+    if (input == "n") {
+        return;
+    }
+
+    std::cout << "change AI difficulty to (1 ~ 5): ";
+    std::getline(std::cin, input);
+    
+    searchDepth = std::stoi(input) % 6;
+    if (searchDepth == 0) {
+        searchDepth = 1;
+    }
+
+    std::cout << "current search depth is " << searchDepth << ".\n";
+}
+
+void state_advice(ChessBoard& cb, TranspositionTable& tt, const OpeningBook& book, PieceSide userSide, uint16_t searchDepth, uint32_t threadCount, uint32_t timeLimitMs) {
+    MoveNode advice;
+    if (!book_probe(book, cb, userSide, advice)){
+        advice = gen_best_move(cb, tt, userSide, searchDepth, threadCount, nullptr, nullptr, timeLimitMs);
+    }
+
+    std::string adviceStr = convert_move_to_str(advice);
+    std::cout << "Maybe you can try: " << adviceStr 
+                        << ", piece is " << piece_get_char(cb.get(advice.begin()))
+                        << ".\n";
+}
+
+void state_repetition_end(PieceSide winner, PieceSide userSide) {
+    std::cout << "The position is repeated for the third time. ";
+    if (winner == PS_EXTRA) {
+        std::cout << "It's a draw!\n";
+    }
+    else if (winner == userSide) {
+        std::cout << "AI never stopped " << (repetitionRule == RR_LONG_CHECK ? "checking" : "checking or chasing") << ", you win!\n";
+    }
+    else {
+        std::cout << "You never stopped " << (repetitionRule == RR_LONG_CHECK ? "checking" : "checking or chasing") << ", you lose!\n";
+    }
+}
+
+/*
+    searches the AI's reply to the user's expected move while the user thinks.
+    the expected move is the first move of the principal variation in the transposition table.
+    if the user plays it, the pondered search goes on to its end and gives the reply,
+    otherwise it is stopped, and what it leaves in the table warms up the real search.
+*/
+class Ponderer{
+    std::thread worker;
+    std::atomic<bool> stopSignal;
+    ChessBoard board;
+    MoveNode expectedMove;
+    MoveNode bestMove;
+    SearchStats stats;
+
+public:
+    Ponderer()
+        : worker{}, stopSignal{ false }, board{}, expectedMove{}, bestMove{}, stats{ } {
+    }
+
+    ~Ponderer(){
+        stop();
+    }
+
+    Ponderer(const Ponderer&) = delete;
+    Ponderer& operator=(const Ponderer&) = delete;
+
+    // start to ponder on the position after the AI's move, nothing happens if there is no expected move.
+    void start(const ChessBoard& cb, TranspositionTable& tt, PieceSide userSide, PieceSide aiSide,
+               uint16_t searchDepth, uint32_t threadCount, uint32_t timeLimitMs){
+        stop();
+
+        board = cb;
+        std::vector<MoveNode> pv;
+        collect_pv(board, tt, userSide, pv, 1);
+        if (pv.empty()){
+            return;
+        }
+
+        expectedMove = pv.front();
+        board.move(expectedMove);
+        stopSignal.store(false, std::memory_order_relaxed);
+        worker = std::thread([this, &tt, aiSide, searchDepth, threadCount, timeLimitMs](){
+            bestMove = gen_best_move(board, tt, aiSide, searchDepth, threadCount, &stats, &stopSignal, timeLimitMs);
+        });
+    }
+
+    // stop pondering, do this before anything else uses the transposition table or changes the search.
+    void stop(){
+        stopSignal.store(true, std::memory_order_relaxed);
+        if (worker.joinable()){
+            worker.join();
+        }
+    }
+
+    /*
+        the user played userMove, if it is the expected move, wait for the pondered search and
+        give its reply and statistics, otherwise stop pondering and return false.
+    */
+    bool finish(const MoveNode& userMove, MoveNode& aiMove, SearchStats& searchStats){
+        if (!worker.joinable()){
+            return false;
+        }
+
+        if (userMove != expectedMove){
+            stop();
+            return false;
+        }
+
+        worker.join();
+        aiMove = bestMove;
+        searchStats = stats;
+        return true;
+    }
+};
+
+void state_try_move(ChessBoard& cb, TranspositionTable& tt, const OpeningBook& book, Ponderer& ponderer, bool pondering, std::string const& userInput, PieceSide userSide, PieceSide aiSide, uint16_t searchDepth, uint32_t threadCount, uint32_t timeLimitMs, StatsMode statsMode, bool& running) {
+    if (!check_input_is_a_move(userInput)) {
+        std::cout << "Input is not a valid move nor instruction, please re-enter(try help ?).\n";
+        return;
+    }
+    
+    MoveNode userMove = convert_input_to_move(userInput);
+    if (!check_is_this_your_piece(cb, userMove, userSide)){
+        std::cout << "This piece is not yours, please choose your piece.\n";
+        return;
+    }
+
+    if (!check_rule(cb, userMove)){
+        std::cout << "Given move doesn't fit for rules, please re-enter.\n";
+        return;
+    }
+
+    cb.move(userMove);
+    draw_board(cb);
+
+    if (check_winner(cb, aiSide) == userSide){
+        ponderer.stop();
+        std::cout << "Congratulations! You win!\n";
+        running = false;
+        return;
+    }
+
+    PieceSide winner;
+    if (check_repetition_end(cb, aiSide, winner)){
+        ponderer.stop();
+        state_repetition_end(winner, userSide);
+        running = false;
+        return;
+    }
+
+    std::cout << "AI thinking...\n";
+
+    SearchStats stats;
+    MoveNode aiMove;
+    bool fromBook = book_probe(book, cb, aiSide, aiMove);
+    bool pondered = false;
+    if (fromBook){
+        ponderer.stop();
+    }
+    else {
+        pondered = ponderer.finish(userMove, aiMove, stats);
+        if (!pondered){
+            aiMove = gen_best_move(cb, tt, aiSide, searchDepth, threadCount, &stats, nullptr, timeLimitMs);
+        }
+    }
+
+    std::string aiMoveStr = convert_move_to_str(aiMove);
+    cb.move(aiMove);
+    draw_board(cb);
+    std::cout << "AI move: " << aiMoveStr
+                << ", piece is '" << piece_get_char(cb.get(aiMove.end())) 
+                << (fromBook ? "', from the opening book.\n" : pondered ? "', found while you were thinking.\n" : "'.\n");
+
+    if (!fromBook && statsMode == SM_TEXT){
+        print_search_stats(stats);
+    }
+    else if (!fromBook && statsMode == SM_JSON){
+        std::cout << search_stats_to_json(stats) << "\n";
+    }
+
+    if (check_winner(cb, userSide) == aiSide){
+        std::cout << "Game over! You lose!\n";
+        running = false;
+        return;
+    }
+
+    if (check_repetition_end(cb, userSide, winner)){
+        state_repetition_end(winner, userSide);
+        running = false;
+        return;
+    }
+
+    if (pondering){
+        ponderer.start(cb, tt, userSide, aiSide, searchDepth, threadCount, timeLimitMs);
+    }
+}
+
+void welcome() {
+    std::cout << "Welcome to this cnchess game, down side is you, upper is AI.\n";
+    std::cout << "You can type 'help' for more detail or just type 'h2e2' to begin.\n";
+}
+
+/*
+    positions used by benchmarks, given as moves played from the default chess board.
+    opening, early middlegame and middlegame.
+*/
+const char* const BENCH_POSITIONS[] = {
+    "",
+    "h2e2 h9g7 h0g2 i9h9",
+    "h2e2 h9g7 h0g2 i9h9 i0h0 b9c7 b2b6 c6c5 g3g4 a9b9",
+};
+
+// play the moves(like "h2e2 h9g7") from side, return the side to move after them, or PS_EXTRA if a move is not legal.
+PieceSide play_moves(ChessBoard& cb, PieceSide side, const std::string& moves){
+    std::istringstream in{ moves };
+    std::string input;
+
+    while (in >> input){
+        if (input.size() != 4 || !check_input_is_a_move(input)){
+            return PS_EXTRA;
+        }
+
+        MoveNode move = convert_input_to_move(input);
+        if (!check_is_this_your_piece(cb, move, side) || !check_rule(cb, move)){
+            return PS_EXTRA;
+        }
+
+        cb.move(move);
+        side = piece_side_get_reverse(side);
+    }
+
+    return side;
+}
+
+// play the given moves on a default chess board, return the side to move, or PS_EXTRA if a move is not legal.
+PieceSide setup_bench_position(ChessBoard& cb, const std::string& moves){
+    cb.clear();
+    return play_moves(cb, PS_DOWN, moves);
+}
+
+/*
+    time to reach searchDepth with 1, 2, 4 ... maxThreadCount lazy smp threads,
+    every run starts with an empty transposition table.
+*/
+void bench_lazy_smp(TranspositionTable& tt, uint16_t searchDepth, uint32_t maxThreadCount){
+    double baseSeconds = 0.0;
+
+    std::cout << "lazy smp benchmark, search depth " << searchDepth << ".\n";
+    std::cout << "threads        time(s)          nodes   speedup\n";
+
+    for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2){
+        double seconds = 0.0;
+        uint64_t nodes = 0;
+
+        for (const char* moves : BENCH_POSITIONS){
+            ChessBoard cb;
+            PieceSide side = setup_bench_position(cb, moves);
+            uint64_t positionNodes = 0;
+
+            tt.clear();
+            auto begin = std::chrono::steady_clock::now();
+            search_lazy_smp(cb, tt, side, searchDepth, threadCount, &positionNodes);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            nodes += positionNodes;
+        }
+
+        if (threadCount == 1){
+            baseSeconds = seconds;
+        }
+
+        std::printf("%7u %14.3f %14llu %9.2f\n", threadCount, seconds,
+                    static_cast<unsigned long long>(nodes), baseSeconds / seconds);
+    }
+}
+
+// compare iterative deepening searches from the start position with the search features turned on one by one.
+void bench_search(TranspositionTable& tt, uint16_t maxDepth){
+    struct Config{
+        const char* name;
+        SearchConfig config;
+    };
+
+    Config configs[4];
+    configs[0].name = "hash move only";
+    configs[1].name = "ordered";
+    configs[2].name = "ordered + pvs";
+    configs[3].name = "+ null move, lmr";
+
+    for (int32_t i = 0; i < 3; ++i){
+        configs[i].config.orderMoves = i >= 1;
+        configs[i].config.usePvs = i >= 2;
+        configs[i].config.nullMove = false;
+        configs[i].config.lmr = false;
+    }
+
+    std::cout << "search benchmark, start position.\n";
+    std::cout << "  depth   config                    nodes    time(s)   re-searches   fail-high   fail-low\n";
+
+    for (uint16_t searchDepth = 1; searchDepth <= maxDepth; ++searchDepth){
+        for (const Config& config : configs){
+            ChessBoard cb;
+            SearchContext ctx{ tt };
+            ctx.config = config.config;
+
+            tt.clear();
+            auto begin = std::chrono::steady_clock::now();
+
+            SearchResult result;
+            for (uint16_t depth = 0; depth <= searchDepth; ++depth){
+                result = search_root_aspiration(cb, ctx, PS_DOWN, depth, result);
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            std::printf("%7u   %-16s %14llu %10.3f %13llu %11llu %10llu\n", searchDepth, config.name,
+                        static_cast<unsigned long long>(ctx.stats.nodes), seconds, static_cast<unsigned long long>(ctx.stats.researches),
+                        static_cast<unsigned long long>(ctx.stats.aspirationFailHighs), static_cast<unsigned long long>(ctx.stats.aspirationFailLows));
+        }
+    }
+}
+
+// leaf nodes of the legal move tree from the start position to depth 0, 1, 2 ..., used to validate the move generator.
+constexpr uint64_t PERFT_START_POSITION_NODES[] = { 1, 44, 1920, 79666, 3290240, 133312995 };
+
+// count the leaf nodes of the legal move tree to depth, the moves of the last ply are counted without being made.
+template <PieceSide Side>
+uint64_t perft(ChessBoard& cb, uint16_t depth){
+    if (depth == 0){
+        return 1;
+    }
+
+    PossibleMoves pm;
+    gen_legal_moves<Side>(cb, pm);
+
+    if (depth == 1){
+        return pm.size();
+    }
+
+    uint64_t nodes = 0;
+    for (const MoveNode& move : pm){
+        cb.move(move);
+        nodes += perft<piece_side_get_reverse(Side)>(cb, depth - 1);
+        cb.undo();
+    }
+
+    return nodes;
+}
+
+/*
+    perft of the move generator from the position, print the leaf nodes under every root move(divide),
+    the total and nodes per second. if checkStartPosition, the total is compared with PERFT_START_POSITION_NODES.
+    return false if it is different.
+*/
+bool run_perft(ChessBoard& cb, PieceSide side, uint16_t depth, bool checkStartPosition){
+    std::cout << "perft depth " << depth << ".\n";
+
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t total = 0;
+
+    if (depth == 0){
+        total = 1;
+    }
+    else {
+        for (const MoveNode& move : gen_legal_moves(cb, side)){
+            cb.move(move);
+            uint64_t nodes = side == PS_UP ? perft<PS_DOWN>(cb, depth - 1) : perft<PS_UP>(cb, depth - 1);
+            cb.undo();
+
+            std::printf("  %s %14llu\n", convert_move_to_str(move).c_str(), static_cast<unsigned long long>(nodes));
+            total += nodes;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("total %llu nodes, %.3f s, %.0f nodes/s.\n", static_cast<unsigned long long>(total), seconds,
+                seconds > 0.0 ? total / seconds : 0.0);
+
+    constexpr size_t KNOWN_DEPTHS = sizeof(PERFT_START_POSITION_NODES) / sizeof(PERFT_START_POSITION_NODES[0]);
+    if (!checkStartPosition || depth >= KNOWN_DEPTHS){
+        return true;
+    }
+
+    if (total != PERFT_START_POSITION_NODES[depth]){
+        std::printf("MISMATCH, the start position should have %llu nodes.\n", static_cast<unsigned long long>(PERFT_START_POSITION_NODES[depth]));
+        return false;
+    }
+
+    std::cout << "matches the known count of the start position.\n";
+    return true;
+}
+
+/*
+    build an opening book from a text file of games, one game a line, as ICCS moves from the start position
+    (like "h2e2 h9g7 h0g2"), lines starting with '#' are comments. the first maxPly moves of every game are
+    counted, a move's weight is how many games played it in the position, a game is only counted up to its
+    first illegal move. return false if a file can't be read or written.
+*/
+bool build_opening_book(const std::string& gamesPath, const std::string& bookPath, uint16_t maxPly){
+    std::ifstream games{ gamesPath };
+    if (!games){
+        std::cout << "can't read " << gamesPath << ".\n";
+        return false;
+    }
+
+    std::vector<BookEntry> records;
+    std::string line;
+    uint64_t gameCount = 0;
+
+    while (std::getline(games, line)){
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        ChessBoard cb;
+        PieceSide side = PS_DOWN;
+        std::istringstream in{ line };
+        std::string input;
+
+        for (uint16_t ply = 0; ply < maxPly && in >> input; ++ply){
+            uint64_t key = book_get_key(cb, side);
+            PieceSide next = play_moves(cb, side, input);
+            if (next == PS_EXTRA){
+                break;
+            }
+
+            records.push_back(BookEntry{ key, 1, convert_input_to_move(input).value, 0 });
+            side = next;
+        }
+
+        ++gameCount;
+    }
+
+    // merge the same moves of the same positions.
+    std::sort(records.begin(), records.end(), [](const BookEntry& a, const BookEntry& b){
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    size_t merged = 0;
+    for (size_t i = 0; i < records.size(); ++i){
+        if (merged > 0 && records[merged - 1].key == records[i].key && records[merged - 1].move == records[i].move){
+            records[merged - 1].weight += records[i].weight;
+        }
+        else {
+            records[merged++] = records[i];
+        }
+    }
+    records.resize(merged);
+
+    BookHeader header{};
+    std::memcpy(header.magic, BOOK_MAGIC, sizeof(header.magic));
+    header.startKey = book_get_key(ChessBoard{}, PS_DOWN);
+    header.count = records.size();
+
+    std::ofstream book{ bookPath, std::ios::binary };
+    book.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    book.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(BookEntry)));
+    if (!book){
+        std::cout << "can't write " << bookPath << ".\n";
+        return false;
+    }
+
+    size_t positions = 0;
+    for (size_t i = 0; i < records.size(); ++i){
+        positions += i == 0 || records[i].key != records[i - 1].key;
+    }
+
+    std::cout << gameCount << " games, " << positions << " positions, " << records.size() << " moves written to " << bookPath << ".\n";
+    return true;
+}
+
+// result of a game in a games file, written as "1-0"(red wins), "0-1" or "1/2-1/2" after its moves.
+enum GameResult{
+    GR_RED_WIN,
+    GR_DRAW,
+    GR_BLACK_WIN,
+    GR_UNKNOWN
+};
+
+// header of a game statistics file, the records follow it.
+struct GameStatsHeader{
+    char magic[8];         // GAME_STATS_MAGIC.
+    uint64_t startKey;     // like BookHeader.
+    uint64_t count;        // number of records.
+    uint64_t games;        // number of games the statistics came from.
+};
+
+// how often a move was played in a position, and how those games ended.
+struct GameStatsEntry{
+    uint64_t key;          // zobrist key of the position with the side to move, like BookEntry.
+    uint16_t move;         // MoveNode::value.
+    uint16_t reserved;
+    uint32_t games;
+    uint32_t redWins;
+    uint32_t draws;
+    uint32_t blackWins;    // games - redWins - draws - blackWins games have no result.
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(GameStatsHeader) == 32 && sizeof(GameStatsEntry) == 32, "statistics records are read from the file as they are");
+
+/*
+    move statistics of positions, added by many threads at once.
+    positions are spread over shards by the top GAME_STATS_SHARD_BITS bits of their key, every shard has its
+    own lock, so threads adding different positions rarely wait for each other. a shard is an open addressing
+    table of the records themselves, an empty slot has no games, so a record costs no more than its 32 bytes
+    and the load factor. shards hold increasing ranges of keys, so the sorted shards one by one are sorted.
+*/
+class GameStatsTable{
+    struct Shard{
+        std::mutex mutex;
+        std::vector<GameStatsEntry> slots;    // size is always power of two.
+        size_t count;
+    };
+
+    std::vector<Shard> shards;
+
+    static size_t slot_hash(uint64_t key, uint16_t move){
+        return static_cast<size_t>(key ^ (move * 0x9E3779B97F4A7C15ULL));
+    }
+
+    static void grow(Shard& shard){
+        std::vector<GameStatsEntry> old(shard.slots.size() * 2);
+        old.swap(shard.slots);
+
+        size_t mask = shard.slots.size() - 1;
+        for (const GameStatsEntry& entry : old){
+            if (entry.games == 0){
+                continue;
+            }
+
+            size_t i = slot_hash(entry.key, entry.move) & mask;
+            while (shard.slots[i].games != 0){
+                i = (i + 1) & mask;
+            }
+            shard.slots[i] = entry;
+        }
+    }
+public:
+    GameStatsTable()
+        : shards(static_cast<size_t>(1) << GAME_STATS_SHARD_BITS)
+    {
+        for (Shard& shard : shards){
+            shard.slots.resize(GAME_STATS_SHARD_INITIAL_SLOTS);
+            shard.count = 0;
+        }
+    }
+
+    void add(uint64_t key, const MoveNode& move, GameResult result){
+        Shard& shard = shards[key >> (64 - GAME_STATS_SHARD_BITS)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // keep the load factor below 0.7.
+        if ((shard.count + 1) * 10 > shard.slots.size() * 7){
+            grow(shard);
+        }
+
+        size_t mask = shard.slots.size() - 1;
+        size_t i = slot_hash(key, move.value) & mask;
+        while (shard.slots[i].games != 0 && (shard.slots[i].key != key || shard.slots[i].move != move.value)){
+            i = (i + 1) & mask;
+        }
+
+        GameStatsEntry& entry = shard.slots[i];
+        if (entry.games == 0){
+            entry.key = key;
+            entry.move = move.value;
+            ++shard.count;
+        }
+
+        ++entry.games;
+        entry.redWins += result == GR_RED_WIN;
+        entry.draws += result == GR_DRAW;
+        entry.blackWins += result == GR_BLACK_WIN;
+    }
+
+    size_t size() const noexcept {
+        size_t count = 0;
+        for (const Shard& shard : shards){
+            count += shard.count;
+        }
+
+        return count;
+    }
+
+    /*
+        write every record sorted by key, then by move. every shard is sorted in place, so nothing can be
+        added after it. only call it when no thread is adding.
+    */
+    void write_sorted(std::ostream& out){
+        for (Shard& shard : shards){
+            auto end = std::remove_if(shard.slots.begin(), shard.slots.end(), [](const GameStatsEntry& entry){
+                return entry.games == 0;
+            });
+            std::sort(shard.slots.begin(), end, [](const GameStatsEntry& a, const GameStatsEntry& b){
+                return a.key != b.key ? a.key < b.key : a.move < b.move;
+            });
+
+            out.write(reinterpret_cast<const char*>(shard.slots.data()), static_cast<std::streamsize>(shard.count * sizeof(GameStatsEntry)));
+        }
+    }
+};
+
+GameResult parse_game_result(const char* token, size_t len){
+    std::string result{ token, len };
+
+    if (result == "1-0"){
+        return GR_RED_WIN;
+    }
+    else if (result == "0-1"){
+        return GR_BLACK_WIN;
+    }
+    else if (result == "1/2-1/2"){
+        return GR_DRAW;
+    }
+
+    return GR_UNKNOWN;
+}
+
+/*
+    replay the games of lines [begin, end) and add their first GAME_STATS_MAX_PLY moves to table.
+    cb and pm are reused for every game, so nothing is allocated for a move. a game is only counted
+    up to its first illegal move. return the number of games.
+*/
+uint64_t ingest_games(const char* begin, const char* end, GameStatsTable& table, ChessBoard& cb, PossibleMoves& pm){
+    uint64_t games = 0;
+
+    for (const char* line = begin; line < end; ){
+        const char* lineEnd = std::find(line, end, '\n');
+        const char* next = lineEnd == end ? end : lineEnd + 1;
+
+        while (lineEnd > line && std::isspace(static_cast<unsigned char>(lineEnd[-1]))){
+            --lineEnd;
+        }
+        if (lineEnd == line || *line == '#'){
+            line = next;
+            continue;
+        }
+
+        // the result is the last word, if there is one.
+        const char* lastWord = lineEnd;
+        while (lastWord > line && !std::isspace(static_cast<unsigned char>(lastWord[-1]))){
+            --lastWord;
+        }
+        GameResult result = parse_game_result(lastWord, lineEnd - lastWord);
+
+        cb.clear();
+        PieceSide side = PS_DOWN;
+        const char* p = line;
+
+        for (uint16_t ply = 0; ply < GAME_STATS_MAX_PLY; ++ply){
+            while (p < lineEnd && std::isspace(static_cast<unsigned char>(*p))){
+                ++p;
+            }
+
+            const char* wordEnd = p;
+            while (wordEnd < lineEnd && !std::isspace(static_cast<unsigned char>(*wordEnd))){
+                ++wordEnd;
+            }
+
+            std::string input{ p, wordEnd };    // short enough for the small string buffer.
+            if (input.size() != 4 || !check_input_is_a_move(input)){
+                break;
+            }
+
+            MoveNode move = convert_input_to_move(input);
+            gen_legal_moves(cb, side, pm);
+            if (std::find(pm.cbegin(), pm.cend(), move) == pm.cend()){
+                break;
+            }
+
+            table.add(book_get_key(cb, side), move, result);
+            cb.move(move);
+            side = piece_side_get_reverse(side);
+            p = wordEnd;
+        }
+
+        ++games;
+        line = next;
+    }
+
+    return games;
+}
+
+/*
+    build a game statistics file from a games file(one game a line, like build_opening_book(), with an
+    optional result at the end). the games file is memory-mapped and cut into GAME_STATS_CHUNK_SIZE chunks
+    at line ends, threadCount threads replay the chunks into one GameStatsTable, then the records are
+    written sorted, so query_game_stats() can binary search them. return false if a file can't be read or written.
+*/
+bool build_game_stats(const std::string& gamesPath, const std::string& statsPath, uint32_t threadCount){
+    MappedFile games;
+    if (!games.open(gamesPath)){
+        std::cout << "can't read " << gamesPath << ".\n";
+        return false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    const char* data = games.data();
+    size_t size = games.size();
+
+    // a chunk owns the lines which start in it.
+    auto chunk_begin = [data, size](size_t chunk){
+        if (chunk == 0){
+            return data;
+        }
+
+        const char* p = std::find(data + std::min(size, chunk * GAME_STATS_CHUNK_SIZE - 1), data + size, '\n');
+        return p == data + size ? p : p + 1;
+    };
+
+    struct Worker{
+        ChessBoard board;
+        PossibleMoves pm;
+        uint64_t games;
+    };
+
+    GameStatsTable table;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (uint32_t i = 0; i < threadCount; ++i){
+        workers.emplace_back(new Worker{ ChessBoard{}, PossibleMoves{}, 0 });
+    }
+
+    size_t chunkCount = (size + GAME_STATS_CHUNK_SIZE - 1) / GAME_STATS_CHUNK_SIZE;
+    parallel_for_work_stealing(chunkCount, threadCount, [&](uint32_t w, size_t chunk){
+        Worker& worker = *workers[w];
+        worker.games += ingest_games(chunk_begin(chunk), chunk_begin(chunk + 1), table, worker.board, worker.pm);
+    });
+
+    GameStatsHeader header{};
+    std::memcpy(header.magic, GAME_STATS_MAGIC, sizeof(header.magic));
+    header.startKey = book_get_key(ChessBoard{}, PS_DOWN);
+    for (const std::unique_ptr<Worker>& worker : workers){
+        header.games += worker->games;
+    }
 
-    // https://stackoverflow.com/questions/17125440/c-win32-console-color
-    WORD get_windows_color_attr(int color) {
-        switch(color) {
-            case Black: 
-                return 0;
-            case Blue: 
-                return FOREGROUND_BLUE;
-            case Green: 
-                return FOREGROUND_GREEN;
-            case Cyan: 
-                return FOREGROUND_GREEN | FOREGROUND_BLUE;
-            case Red: 
-                return FOREGROUND_RED;
-            case Magenta: 
-                return FOREGROUND_RED | FOREGROUND_BLUE;
-            case Yellow: 
-                return FOREGROUND_RED | FOREGROUND_GREEN;
-            case White:
-                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-            case BoldBlack: 
-                return 0 | FOREGROUND_INTENSITY;
-            case BoldBlue: 
-                return FOREGROUND_BLUE | FOREGROUND_INTENSITY;
-            case BoldGreen: 
-                return FOREGROUND_GREEN | FOREGROUND_INTENSITY;
-            case BoldCyan: 
-                return FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
-            case BoldRed: 
-                return FOREGROUND_RED | FOREGROUND_INTENSITY;
-            case BoldMagenta: 
-                return FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
-            case BoldYellow: 
-                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
-            case BoldWhite:
-            default:
-                return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
-        };
+    header.count = table.size();
+
+    std::ofstream stats{ statsPath, std::ios::binary };
+    stats.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    table.write_sorted(stats);
+    if (!stats){
+        std::cout << "can't write " << statsPath << ".\n";
+        return false;
     }
-    #endif
-public:
-    enum {
-        Black, 
-        Red, 
-        Green, 
-        Yellow, 
-        Blue, 
-        Magenta, 
-        Cyan, 
-        White,
-        BoldBlack, 
-        BoldRed, 
-        BoldGreen, 
-        BoldYellow, 
-        BoldBlue, 
-        BoldMagenta, 
-        BoldCyan, 
-        BoldWhite
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("%llu games, %llu moves of positions written to %s, %.3f s, %.0f games/s.\n",
+                static_cast<unsigned long long>(header.games), static_cast<unsigned long long>(header.count), statsPath.c_str(), seconds,
+                seconds > 0.0 ? header.games / seconds : 0.0);
+    return true;
+}
+
+// print the moves played in the position and how those games ended, from a game statistics file.
+bool query_game_stats(const std::string& statsPath, const ChessBoard& cb, PieceSide side){
+    MappedFile file;
+    const GameStatsHeader* header = nullptr;
+
+    if (file.open(statsPath) && file.size() >= sizeof(GameStatsHeader)){
+        header = reinterpret_cast<const GameStatsHeader*>(file.data());
+    }
+
+    if (header == nullptr || std::memcmp(header->magic, GAME_STATS_MAGIC, sizeof(header->magic)) != 0 ||
+        header->startKey != book_get_key(ChessBoard{}, PS_DOWN) ||
+        header->count != (file.size() - sizeof(GameStatsHeader)) / sizeof(GameStatsEntry)){
+        std::cout << statsPath << " is not a valid game statistics file.\n";
+        return false;
+    }
+
+    const GameStatsEntry* entries = reinterpret_cast<const GameStatsEntry*>(file.data() + sizeof(GameStatsHeader));
+    auto range = find_records_by_key(entries, static_cast<size_t>(header->count), book_get_key(cb, side));
+
+    std::vector<GameStatsEntry> moves(range.first, range.second);
+    std::sort(moves.begin(), moves.end(), [](const GameStatsEntry& a, const GameStatsEntry& b){
+        return a.games > b.games;
+    });
+
+    std::printf("%zu moves of this position in %llu games.\n", moves.size(), static_cast<unsigned long long>(header->games));
+    if (moves.empty()){
+        return true;
+    }
+
+    std::cout << "  move        games   red win%    draw%   black win%\n";
+    for (const GameStatsEntry& entry : moves){
+        MoveNode move;
+        move.value = entry.move;
+
+        std::printf("  %s %12u %10.1f %8.1f %12.1f\n", convert_move_to_str(move).c_str(), entry.games,
+                    100.0 * entry.redWins / entry.games, 100.0 * entry.draws / entry.games, 100.0 * entry.blackWins / entry.games);
+    }
+
+    return true;
+}
+
+/*
+    the empty squares the piece p on sq may have come from by a move which didn't capture, by the way p moves backwards.
+    a knight's leg, a bishop's eye or where p can't go is not checked, the move is verified by its generator instead.
+*/
+int32_t tablebase_gen_unmove_squares(const ChessBoard& cb, Piece p, int32_t sq, std::array<int32_t, 32>& from){
+    const int32_t orthogonal[] = { SQUARE_UP_OFFSET, SQUARE_DOWN_OFFSET, SQUARE_LEFT_OFFSET, SQUARE_RIGHT_OFFSET };
+    const int32_t diagonal[] = {
+        SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET, SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET,
+        SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET, SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET
+    };
+    const int32_t knight[] = {
+        2 * SQUARE_UP_OFFSET + SQUARE_LEFT_OFFSET, 2 * SQUARE_UP_OFFSET + SQUARE_RIGHT_OFFSET,
+        2 * SQUARE_DOWN_OFFSET + SQUARE_LEFT_OFFSET, 2 * SQUARE_DOWN_OFFSET + SQUARE_RIGHT_OFFSET,
+        2 * SQUARE_LEFT_OFFSET + SQUARE_UP_OFFSET, 2 * SQUARE_LEFT_OFFSET + SQUARE_DOWN_OFFSET,
+        2 * SQUARE_RIGHT_OFFSET + SQUARE_UP_OFFSET, 2 * SQUARE_RIGHT_OFFSET + SQUARE_DOWN_OFFSET
     };
 
-    ConsoleColor() {
-    #ifdef _WIN32
-        CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
-    hOutHandle = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleScreenBufferInfo(hOutHandle, &csbiInfo);
-    oldColorAttrs = csbiInfo.wAttributes;
-    #endif
+    int32_t n = 0;
+    auto add = [&cb, &from, &n](int32_t target){
+        if (cb.get(target) == P_EE){
+            from[n++] = target;
+        }
+    };
+
+    switch (piece_get_type(p)){
+    case PT_ROOK:
+    case PT_CANNON:     // a cannon moves like a rook when it doesn't capture.
+        for (int32_t offset : orthogonal){
+            for (int32_t target = sq + offset; cb.get(target) == P_EE; target += offset){
+                from[n++] = target;
+            }
+        }
+        break;
+    case PT_KNIGHT:
+        for (int32_t offset : knight){
+            add(sq + offset);
+        }
+        break;
+    case PT_BISHOP:
+        for (int32_t offset : diagonal){
+            add(sq + 2 * offset);
+        }
+        break;
+    case PT_ADVISOR:
+        for (int32_t offset : diagonal){
+            add(sq + offset);
+        }
+        break;
+    case PT_GENERAL:
+        for (int32_t offset : orthogonal){
+            add(sq + offset);
+        }
+        break;
+    case PT_PAWN:
+        add(sq - side_get_forward_offset(piece_get_side(p)));
+        add(sq + SQUARE_LEFT_OFFSET);
+        add(sq + SQUARE_RIGHT_OFFSET);
+        break;
+    default:
+        break;
     }
 
-    ~ConsoleColor() noexcept {
-        reset();
+    return n;
+}
+
+/*
+    call fn(cb) with every legal position of the same material which moves to cb, side to move, by a move of the
+    other side. cb is changed to the position during the call, and is the same after it returns.
+*/
+template <typename Fn>
+void tablebase_for_each_predecessor(ChessBoard& cb, PieceSide side, PossibleMoves& pm, Fn fn){
+    PieceSide mover = piece_side_get_reverse(side);
+    std::array<int32_t, 32> from;
+
+    for (int32_t type = PT_PAWN; type <= PT_GENERAL; ++type){
+        Piece p = piece_make(mover, static_cast<PieceType>(type));
+        std::array<uint8_t, MAX_ONE_KIND_PIECES_LEN> squares;
+        int32_t count = cb.get_piece_count(p);
+        std::copy(cb.get_piece_squares(p), cb.get_piece_squares(p) + count, squares.begin());
+
+        for (int32_t i = 0; i < count; ++i){
+            int32_t sq = squares[i];
+
+            for (int32_t j = 0, n = tablebase_gen_unmove_squares(cb, p, sq, from); j < n; ++j){
+                if (tablebaseIndexing.indexes[p][from[j]] < 0){
+                    continue;
+                }
+
+                cb.move(MoveNode(sq, from[j]));
+                pm.clear();
+                gen_moves_of_square(cb, mover, pm, from[j]);
+                if (std::find(pm.begin(), pm.end(), MoveNode(from[j], sq)) != pm.end() && !is_in_check(cb, side)){
+                    fn(cb);
+                }
+                cb.undo();
+            }
+        }
     }
+}
 
-    void set(int color) noexcept {
-        #if defined(__linux__) || defined(__Free_BSD__)
-        switch(color) {
-            case Black:
-                std::cout << "\033[30m"; break;
-            case Red:
-                std::cout << "\033[31m"; break;
-            case Green:
-                std::cout << "\033[32m"; break;
-            case Yellow:       
-                std::cout << "\033[33m"; break;
-            case Blue:         
-                std::cout << "\033[34m"; break;
-            case Magenta:      
-                std::cout << "\033[35m"; break;
-            case Cyan:         
-                std::cout << "\033[36m"; break;
-            case White:        
-                std::cout << "\033[37m"; break;
-            case BoldBlack:    
-                std::cout << "\033[1m\033[30m"; break;
-            case BoldRed:      
-                std::cout << "\033[1m\033[31m"; break;
-            case BoldGreen:    
-                std::cout << "\033[1m\033[32m"; break;
-            case BoldYellow:   
-                std::cout << "\033[1m\033[33m"; break;
-            case BoldBlue:     
-                std::cout << "\033[1m\033[34m"; break;
-            case BoldMagenta:  
-                std::cout << "\033[1m\033[35m"; break;
-            case BoldCyan:     
-                std::cout << "\033[1m\033[36m"; break;
-            case BoldWhite:  
-            default:  
-                std::cout << "\033[1m\033[37m"; break;
+// tables solved by a tablebase generation, a table is solved after every table it captures into.
+struct TablebaseBuild{
+    std::vector<std::pair<TablebaseMaterial, std::vector<uint8_t>>> tables;
+
+    const std::vector<uint8_t>* find(uint64_t code) const {
+        for (const auto& table : tables){
+            if (table.first.code == code){
+                return &table.second;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+// like "KRkaabb", the red(down) pieces in upper case, then the black(up) pieces in lower case.
+std::string tablebase_material_to_str(const TablebaseMaterial& material){
+    std::string up = "k";
+    std::string down = "K";
+
+    for (uint32_t i = 0; i < material.count; ++i){
+        Piece p = material.pieces[i];
+        (piece_get_side(p) == PS_UP ? up : down) += piece_get_fen_char(p);
+    }
+
+    return down + up;
+}
+
+// the reverse of tablebase_material_to_str(), the generals can be left out, and the pieces can be in any order.
+bool tablebase_material_from_str(const std::string& text, TablebaseMaterial& material){
+    uint64_t code = 0;
+
+    for (char ch : text){
+        Piece p = piece_from_fen_char(ch);
+        if (p == P_EO){
+            return false;
+        }
+
+        if (piece_get_type(p) != PT_GENERAL){
+            if (((code >> (3 * p)) & 7) == 7){
+                return false;
+            }
+
+            code += 1ULL << (3 * p);
+        }
+    }
+
+    return tablebase_material_from_code(code, material);
+}
+
+/*
+    solve the table of the material code by retrograde analysis, after the tables it captures into.
+    positions are resolved in layers of their distance to mate: layer 0 is every position without a legal move,
+    a position moving into a lost one of layer n wins in n + 1, and a position whose moves all go into won ones
+    loses in n + 1 when its last move is counted. the predecessors of a layer are generated by moving the pieces
+    backwards, threadCount threads share them in chunks. captures leave the table, so they are looked up once
+    at the beginning. the positions never resolved are draws.
+*/
+bool solve_tablebase(TablebaseBuild& build, uint64_t code, uint32_t threadCount){
+    if (build.find(code) != nullptr){
+        return true;
+    }
+
+    TablebaseMaterial material;
+    tablebase_material_from_code(code, material);
+    if (material.size > TABLEBASE_MAX_POSITIONS){
+        std::printf("%s has %llu positions, more than %llu.\n", tablebase_material_to_str(material).c_str(),
+                    static_cast<unsigned long long>(material.size), static_cast<unsigned long long>(TABLEBASE_MAX_POSITIONS));
+        return false;
+    }
+
+    for (uint32_t i = 0; i < material.count; ++i){
+        if (!solve_tablebase(build, code - (1ULL << (3 * material.pieces[i])), threadCount)){
+            return false;
+        }
+    }
+
+    // build.tables doesn't grow until this table is solved.
+    std::array<const std::vector<uint8_t>*, P_EE> subTables{};
+    std::array<TablebaseMaterial, P_EE> subMaterials;
+    for (uint32_t i = 0; i < material.count; ++i){
+        Piece p = material.pieces[i];
+        subTables[p] = build.find(code - (1ULL << (3 * p)));
+        tablebase_material_from_code(code - (1ULL << (3 * p)), subMaterials[p]);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::unique_ptr<std::atomic<uint8_t>[]> values{ new std::atomic<uint8_t>[material.size] };
+    std::unique_ptr<std::atomic<uint8_t>[]> counters{ new std::atomic<uint8_t>[material.size] };    // legal moves not known to be lost.
+
+    using PositionSquares = std::array<uint8_t, TABLEBASE_MAX_PIECES + 2>;
+    struct Worker{
+        ChessBoard board;
+        PositionSquares placed;
+        PossibleMoves pm;
+        std::vector<uint32_t> resolved;                      // positions resolved for the next layer.
+        std::vector<std::vector<uint32_t>> captureWins;      // by layer, positions winning by a capture.
+        std::vector<std::vector<uint32_t>> captureLosses;    // by layer, positions with a capture into a position won in that layer.
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (uint32_t i = 0; i < threadCount; ++i){
+        workers.emplace_back(new Worker());
+
+        Worker& worker = *workers.back();
+        for (int32_t sq = 0; sq < BOARD_SQUARE_LEN; ++sq){
+            if (worker.board.get(sq) != P_EO){
+                worker.board.set(sq, P_EE);
+            }
+        }
+
+        worker.placed.fill(static_cast<uint8_t>(square_make(BOARD_ACTUAL_ROW_BEGIN, BOARD_ACTUAL_COL_BEGIN)));
+        worker.captureWins.resize(TABLEBASE_ILLEGAL);
+        worker.captureLosses.resize(TABLEBASE_ILLEGAL);
+    }
+
+    auto place = [&material](Worker& worker, const PositionSquares& squares){
+        for (uint32_t i = 0; i < material.count + 2; ++i){
+            worker.board.set(worker.placed[i], P_EE);
+        }
+
+        worker.board.set(squares[0], P_UG);
+        worker.board.set(squares[1], P_DG);
+        for (uint32_t i = 0; i < material.count; ++i){
+            worker.board.set(squares[2 + i], material.pieces[i]);
+        }
+
+        worker.placed = squares;
+        worker.board.rebuild_states();
+    };
+
+    size_t chunkCount = static_cast<size_t>((material.size + TABLEBASE_CHUNK_SIZE - 1) / TABLEBASE_CHUNK_SIZE);
+    parallel_for_work_stealing(chunkCount, threadCount, [&](uint32_t w, size_t chunk){
+        Worker& worker = *workers[w];
+        ChessBoard& cb = worker.board;
+        PositionSquares squares;
+        PieceSide side;
+
+        uint64_t end = std::min<uint64_t>(material.size, static_cast<uint64_t>(chunk + 1) * TABLEBASE_CHUNK_SIZE);
+        for (uint64_t i = static_cast<uint64_t>(chunk) * TABLEBASE_CHUNK_SIZE; i < end; ++i){
+            counters[i].store(0, std::memory_order_relaxed);
+            if (!tablebase_decode(material, i, squares, side)){
+                values[i].store(TABLEBASE_ILLEGAL, std::memory_order_relaxed);
+                continue;
+            }
+
+            place(worker, squares);
+            PieceSide enemy = piece_side_get_reverse(side);
+            if (is_in_check(cb, enemy)){
+                values[i].store(TABLEBASE_ILLEGAL, std::memory_order_relaxed);
+                continue;
+            }
+
+            gen_legal_moves(cb, side, worker.pm);
+            if (worker.pm.empty()){
+                values[i].store(0, std::memory_order_relaxed);
+                worker.resolved.push_back(static_cast<uint32_t>(i));
+                continue;
+            }
+
+            uint8_t captureWin = TABLEBASE_DRAW;
+            std::array<uint8_t, MAX_ONE_SIDE_POSSIBLE_MOVES_LEN> lostIn;
+            size_t lostCount = 0;
+            for (const MoveNode& move : worker.pm){
+                Piece captured = cb.get(move.end());
+                if (captured == P_EE){
+                    continue;
+                }
+
+                uint64_t subIndex;
+                cb.move(move);
+                tablebase_encode(subMaterials[captured], cb, enemy, subIndex);
+                uint8_t value = (*subTables[captured])[subIndex];
+                cb.undo();
+
+                if (value >= TABLEBASE_ILLEGAL){
+                    continue;
+                }
+                else if (value % 2 == 0){
+                    captureWin = std::min<uint8_t>(captureWin, value + 1);
+                }
+                else {
+                    lostIn[lostCount++] = value;
+                }
+            }
+
+            values[i].store(TABLEBASE_DRAW, std::memory_order_relaxed);
+            counters[i].store(static_cast<uint8_t>(worker.pm.size()), std::memory_order_relaxed);
+            if (captureWin != TABLEBASE_DRAW){
+                worker.captureWins[captureWin].push_back(static_cast<uint32_t>(i));
+            }
+            else {
+                for (size_t k = 0; k < lostCount; ++k){
+                    worker.captureLosses[lostIn[k]].push_back(static_cast<uint32_t>(i));
+                }
+            }
+        }
+    });
+
+    uint32_t lastCaptureLayer = 0;
+    for (const std::unique_ptr<Worker>& worker : workers){
+        for (uint32_t n = 0; n < TABLEBASE_ILLEGAL; ++n){
+            if (!worker->captureWins[n].empty() || !worker->captureLosses[n].empty()){
+                lastCaptureLayer = std::max(lastCaptureLayer, n);
+            }
+        }
+    }
+
+    std::vector<uint32_t> current;
+    for (uint32_t n = 0; ; ++n){
+        std::vector<uint32_t> next;
+
+        for (const std::unique_ptr<Worker>& worker : workers){
+            current.insert(current.end(), worker->resolved.begin(), worker->resolved.end());
+            worker->resolved.clear();
+
+            for (uint32_t i : worker->captureWins[n]){
+                if (values[i].load(std::memory_order_relaxed) == TABLEBASE_DRAW){
+                    values[i].store(static_cast<uint8_t>(n), std::memory_order_relaxed);
+                    current.push_back(i);
+                }
+            }
+
+            for (uint32_t i : worker->captureLosses[n]){
+                if (counters[i].fetch_sub(1, std::memory_order_relaxed) == 1 && values[i].load(std::memory_order_relaxed) == TABLEBASE_DRAW){
+                    values[i].store(static_cast<uint8_t>(n + 1), std::memory_order_relaxed);
+                    next.push_back(i);
+                }
+            }
+
+            std::vector<uint32_t>().swap(worker->captureWins[n]);
+            std::vector<uint32_t>().swap(worker->captureLosses[n]);
+        }
+
+        if (current.empty() && next.empty() && n >= lastCaptureLayer){
+            break;
+        }
+
+        if (n + 1 >= TABLEBASE_ILLEGAL){
+            std::printf("%s has a mate longer than %d plies.\n", tablebase_material_to_str(material).c_str(), TABLEBASE_ILLEGAL - 1);
+            return false;
+        }
+
+        size_t taskCount = (current.size() + TABLEBASE_CHUNK_SIZE - 1) / TABLEBASE_CHUNK_SIZE;
+        parallel_for_work_stealing(taskCount, threadCount, [&](uint32_t w, size_t task){
+            Worker& worker = *workers[w];
+            PositionSquares squares;
+            PieceSide side;
+
+            size_t end = std::min(current.size(), (task + 1) * TABLEBASE_CHUNK_SIZE);
+            for (size_t k = task * TABLEBASE_CHUNK_SIZE; k < end; ++k){
+                tablebase_decode(material, current[k], squares, side);
+                place(worker, squares);
+
+                tablebase_for_each_predecessor(worker.board, side, worker.pm, [&](const ChessBoard& cb){
+                    uint64_t index;
+                    tablebase_encode(material, cb, piece_side_get_reverse(side), index);
+
+                    // a move into a won position is one less way out, the predecessor is lost when it has none left.
+                    if (n % 2 == 1 && counters[index].fetch_sub(1, std::memory_order_relaxed) != 1){
+                        return;
+                    }
+
+                    uint8_t draw = TABLEBASE_DRAW;
+                    if (values[index].compare_exchange_strong(draw, static_cast<uint8_t>(n + 1), std::memory_order_relaxed)){
+                        worker.resolved.push_back(static_cast<uint32_t>(index));
+                    }
+                });
+            }
+        });
+
+        current.swap(next);
+    }
+
+    std::vector<uint8_t> table(static_cast<size_t>(material.size));
+    uint64_t wins = 0;
+    uint64_t losses = 0;
+    uint64_t draws = 0;
+    uint8_t longest = 0;
+    for (uint64_t i = 0; i < material.size; ++i){
+        uint8_t value = table[i] = values[i].load(std::memory_order_relaxed);
+
+        if (value == TABLEBASE_DRAW){
+            ++draws;
+        }
+        else if (value != TABLEBASE_ILLEGAL){
+            ++(value % 2 == 1 ? wins : losses);
+            longest = std::max(longest, value);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("%-10s %12llu positions, side to move wins %5.1f%%, loses %5.1f%%, draws %5.1f%%, longest mate %3u plies, %.3f s.\n",
+                tablebase_material_to_str(material).c_str(), static_cast<unsigned long long>(wins + losses + draws),
+                100.0 * search_stats_ratio(wins, wins + losses + draws), 100.0 * search_stats_ratio(losses, wins + losses + draws),
+                100.0 * search_stats_ratio(draws, wins + losses + draws), longest, seconds);
+
+    build.tables.emplace_back(material, std::move(table));
+    return true;
+}
+
+/*
+    generate the endgame tablebase of a material(like "KRkaabb", see tablebase_material_to_str()) and of every
+    material it captures into with threadCount threads, then write them to a file which EndgameTablebase can map.
+    return false if the material is not valid, a table is too big, or the file can't be written.
+*/
+bool build_endgame_tablebase(const std::string& materialText, const std::string& path, uint32_t threadCount){
+    TablebaseMaterial material;
+    if (!tablebase_material_from_str(materialText, material)){
+        std::cout << materialText << " is not a material of up to " << TABLEBASE_MAX_PIECES << " pieces besides the generals.\n";
+        return false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    TablebaseBuild build;
+    if (!solve_tablebase(build, material.code, threadCount)){
+        return false;
+    }
+
+    TablebaseHeader header{};
+    std::memcpy(header.magic, TABLEBASE_MAGIC, sizeof(header.magic));
+    header.count = build.tables.size();
+
+    std::vector<TablebaseDirectoryEntry> entries;
+    uint64_t offset = sizeof(TablebaseHeader) + header.count * sizeof(TablebaseDirectoryEntry);
+    for (const auto& table : build.tables){
+        entries.push_back(TablebaseDirectoryEntry{ table.first.code, offset, table.first.size });
+        offset += table.first.size;
+    }
+
+    std::ofstream file{ path, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(TablebaseDirectoryEntry));
+    for (const auto& table : build.tables){
+        file.write(reinterpret_cast<const char*>(table.second.data()), table.second.size());
+    }
+
+    if (!file){
+        std::cout << "can't write " << path << ".\n";
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("%zu tables, %llu bytes written to %s, %.3f s.\n", build.tables.size(), static_cast<unsigned long long>(offset),
+                path.c_str(), seconds);
+    return true;
+}
+
+/*
+    engine mode speaking UCCI, the xiangqi version of UCI, on stdin and stdout:
+        ucci(or uci), isready, setoption hashsize <MB>(or name Hash value <MB>), ucinewgame,
+        position {startpos | fen <fen>} [moves <move> ...],
+        go [depth <d> | movetime <ms> | infinite | time(wtime, btime) <ms> [increment(winc, binc) <ms>] [movestogo <n>]],
+        stop, quit.
+    moves are in ICCS like "h2e2", the red side is the down side. the search runs on a worker thread while this
+    thread keeps reading commands, so "stop" is answered within SEARCH_CHECK_TIME_NODES nodes.
+    a "go"(but "go infinite") in a position of the opening book is answered with a book move at once.
+*/
+class UcciEngine{
+    // limits of one "go", 0 for no limit.
+    struct GoLimits{
+        uint16_t depth;          // in plies, the same as the depth of "info".
+        uint32_t timeLimitMs;
+        bool infinite;           // bestmove is held back until "stop".
+    };
+
+    TranspositionTable& tt;
+    const OpeningBook& book;
+    ChessBoard board;
+    PieceSide sideToMove;
+    bool uci;                    // the interface said "uci", so scores are "cp" or "mate" and the reply is "uciok".
+    std::thread worker;
+    std::atomic<bool> stopSignal;
+    std::mutex outputMutex;      // info lines of the worker and replies of this thread don't mix.
+
+    void send(const std::string& line){
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << line << std::endl;
+    }
+
+    void stop_search(){
+        stopSignal.store(true, std::memory_order_relaxed);
+        if (worker.joinable()){
+            worker.join();
         }
-        #elif defined(_WIN32)
-        SetConsoleTextAttribute(hOutHandle, get_windows_color_attr(color));
-        #endif
     }
 
-    void reset() noexcept {
-        #if defined(__linux__) || defined(__Free_BSD__)
-        std::cout << "\033[0m";
-        #elif defined(_WIN32)
-        SetConsoleTextAttribute(hOutHandle, oldColorAttrs);
-        #endif
+    void set_option(std::istringstream& in){
+        std::string name;
+        std::string token;
+        in >> name;
+
+        if (name == "name"){
+            in >> name >> token;
+        }
+
+        if ((name == "hashsize" || name == "Hash") && in >> token){
+            long sizeMB = std::atol(token.c_str());
+            tt.resize(static_cast<size_t>(std::min<long>(std::max<long>(sizeMB, 1), MAX_TRANSPOSITION_TABLE_SIZE_MB)));
+        }
     }
-};
 
-void draw_board(const ChessBoard& cb){
-    ConsoleColor cc;
-    int n = BOARD_ROW_LEN - 1;
+    void set_position(std::istringstream& in){
+        std::string token;
+        PieceSide side = PS_DOWN;
+        in >> token;
 
-    std::cout << "\n    +-------------------+\n";
+        if (token == "fen"){
+            std::string fen;
+            while (in >> token && token != "moves"){
+                fen += fen.empty() ? token : " " + token;
+            }
 
-    int r, c;
-    for (r = BOARD_ACTUAL_ROW_BEGIN; r <= BOARD_ACTUAL_ROW_END; ++r) {
-        if (r == BOARD_CHU_HAN_LINE){
-            std::cout << "    |===================|\n";
-            std::cout << "    |===================|\n";
+            if (!board_set_fen(board, fen, side)){
+                send("info string invalid fen, use the start position.");
+                board.clear();
+                side = PS_DOWN;
+            }
+        }
+        else {
+            board.clear();
+            in >> token;
         }
 
-        cc.set(ConsoleColor::Yellow);
-        std::cout << " " << n--;
-        cc.reset();
+        sideToMove = side;
+        if (token != "moves"){
+            return;
+        }
 
-        std::cout << "  | ";
+        while (in >> token){
+            side = play_moves(board, sideToMove, token);
+            if (side == PS_EXTRA){
+                send("info string illegal move " + token + ", the rest are ignored.");
+                return;
+            }
 
-        for (c = BOARD_ACTUAL_COL_BEGIN; c <= BOARD_ACTUAL_COL_END; ++c){
-            Piece p = cb.get(r, c);
+            sideToMove = side;
+        }
+    }
 
-            if (piece_get_side(p) == PS_UP) {
-                cc.set(ConsoleColor::BoldBlue);
+    GoLimits parse_go(std::istringstream& in) const {
+        GoLimits limits{ 0, 0, false };
+        uint32_t timeLeftMs = 0;
+        uint32_t incrementMs = 0;
+        uint32_t movesToGo = 0;
+        bool red = sideToMove == PS_DOWN;
+        std::string token;
+
+        // the other side's wtime or btime is skipped, its value is read as an unknown token.
+        while (in >> token){
+            if (token == "infinite"){
+                limits.infinite = true;
             }
-            else if (piece_get_side(p) == PS_DOWN) {
-                cc.set(ConsoleColor::BoldRed);
+            else if (token == "depth"){
+                in >> limits.depth;
             }
-            else {
-                cc.set(ConsoleColor::White);
+            else if (token == "movetime"){
+                in >> limits.timeLimitMs;
             }
+            else if (token == "time" || token == (red ? "wtime" : "btime")){
+                in >> timeLeftMs;
+            }
+            else if (token == "increment" || token == (red ? "winc" : "binc")){
+                in >> incrementMs;
+            }
+            else if (token == "movestogo"){
+                in >> movesToGo;
+            }
+        }
 
-            std::cout << piece_get_char(p) << " ";
-            cc.reset();
+        if (limits.timeLimitMs == 0 && timeLeftMs > 0){
+            uint32_t share = timeLeftMs / (movesToGo > 0 ? movesToGo : UCCI_DEFAULT_MOVES_TO_GO) + incrementMs;
+            uint32_t usable = timeLeftMs > 2 * UCCI_TIME_MARGIN_MS ? timeLeftMs - UCCI_TIME_MARGIN_MS : timeLeftMs / 2;
+            limits.timeLimitMs = std::max<uint32_t>(1, std::min(share, usable));
         }
 
-        std::cout << "|\n";
+        return limits;
     }
 
-    std::cout << "    +-------------------+\n";
+    std::string format_score(int32_t score) const {
+        if (!uci){
+            return "score " + std::to_string(score);
+        }
 
-    cc.set(ConsoleColor::BoldGreen);
-    std::cout << "\n      a b c d e f g h i\n\n";
-    cc.reset();
-}
+        if (std::abs(score) <= SCORE_MATE_BOUND){
+            return "score cp " + std::to_string(score);
+        }
 
-void print_help_page(){
-    std::cout << "\n=======================================\n";
-    std::cout << "Help Page\n\n";
-    std::cout << "    1. help         - this page.\n";
-    std::cout << "    2. b2e2         - input like this will be parsed as a move.\n";
-    std::cout << "    3. undo         - undo the previous move.\n";
-    std::cout << "    4. exit or quit - exit the game.\n";
-    std::cout << "    5. remake       - remake the game.\n";
-    std::cout << "    6. diff         - change the AI difficulty.\n";
-    std::cout << "    7. advice       - give me a best move.\n\n";
-    std::cout << "  The characters on the board have the following relationships: \n\n";
-    std::cout << "    P -> AI side pawn.\n";
-    std::cout << "    C -> AI side cannon.\n";
-    std::cout << "    R -> AI side rook.\n";
-    std::cout << "    N -> AI side knight.\n";
-    std::cout << "    B -> AI side bishop.\n";
-    std::cout << "    A -> AI side advisor.\n";
-    std::cout << "    G -> AI side general.\n";
-    std::cout << "    p -> our pawn.\n";
-    std::cout << "    c -> our cannon.\n";
-    std::cout << "    r -> our rook.\n";
-    std::cout << "    n -> our knight.\n";
-    std::cout << "    b -> our bishop.\n";
-    std::cout << "    a -> our advisor.\n";
-    std::cout << "    g -> our general.\n";
-    std::cout << "    . -> no piece here.\n";
-    std::cout << "=======================================\n";
-    std::cout << "Press any key to continue.\n";
+        int32_t moves = (SCORE_MATE - std::abs(score) + 1) / 2;
+        return "score mate " + std::to_string(score > 0 ? moves : -moves);
+    }
 
-    // ignore any input.    
-    std::string line;
-    std::getline(std::cin, line);
-}
+    void send_info(const SearchResult& result, const SearchStats& stats){
+        uint64_t ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - stats.begin).count());
+        uint64_t nodes = stats.nodes;
+
+        std::string line = "info depth " + std::to_string(result.depth + 1) + " seldepth " + std::to_string(stats.selDepth) + " " +
+                           format_score(score_for_side(result.score, sideToMove)) +
+                           " time " + std::to_string(ms) + " nodes " + std::to_string(nodes) +
+                           " nps " + std::to_string(nodes * 1000 / std::max<uint64_t>(ms, 1)) + " pv";
+        for (const MoveNode& move : result.pv){
+            line += " " + convert_move_to_str(move);
+        }
 
-void state_help(ChessBoard const& cb) {
-    print_help_page();
-    draw_board(cb);
-}
+        send(line);
+    }
 
-void state_undo(ChessBoard& cb) {
-    cb.undo();
-    cb.undo();
-    draw_board(cb);
-}
+    // the worker thread runs it for every "go".
+    void search(GoLimits limits){
+        SearchContext ctx{ tt };
+        ctx.stopSignal = &stopSignal;
 
-void state_remake(ChessBoard& cb) {
-    cb.clear();
-    std::cout << "New cnchess started.\n";
-    draw_board(cb);
-}
+        // search depth d searches d + 1 plies.
+        uint16_t maxDepth = limits.depth > 0 ? std::min<uint16_t>(limits.depth - 1, MAX_SEARCH_DEPTH) : MAX_SEARCH_DEPTH;
 
-void state_diff(uint16_t& searchDepth) {
-    std::string input;
-    std::cout << "Current difficulty is " << searchDepth << ", want to change it(y/n)? ";
-    
-    std::getline(std::cin, input);
-    if (input == "n") {
-        return;
-    }
+        SearchResult best = search_iterative_deepening(board, ctx, sideToMove, maxDepth, limits.timeLimitMs, [this, &ctx](const SearchResult& result){
+            send_info(result, ctx.stats);
+        });
 
-    std::cout << "change AI difficulty to (1 ~ 5): ";
-    std::getline(std::cin, input);
-    
-    searchDepth = std::stoi(input) % 6;
-    if (searchDepth == 0) {
-        searchDepth = 1;
-    }
+        while (limits.infinite && !stopSignal.load(std::memory_order_relaxed)){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-    std::cout << "current search depth is " << searchDepth << ".\n";
-}
+        // stopped before the first iteration completed, any legal move is better than none.
+        if (best.pv.empty()){
+            PossibleMoves pm = gen_legal_moves(board, sideToMove);
+            if (pm.empty()){
+                send("nobestmove");
+                return;
+            }
 
-void state_advice(ChessBoard& cb, PieceSide userSide, uint16_t searchDepth) {
-    MoveNode advice = gen_best_move(cb, userSide, searchDepth);
-    std::string adviceStr = convert_move_to_str(advice);
-    std::cout << "Maybe you can try: " << adviceStr 
-                        << ", piece is " << piece_get_char(cb.get(advice.beginRow, advice.beginCol))
-                        << ".\n";
-}
+            best.bestMove = pm[0];
+        }
 
-void state_try_move(ChessBoard& cb, std::string const& userInput, PieceSide userSide, PieceSide aiSide, uint16_t searchDepth, bool& running) {
-    if (!check_input_is_a_move(userInput)) {
-        std::cout << "Input is not a valid move nor instruction, please re-enter(try help ?).\n";
-        return;
-    }
-    
-    MoveNode userMove = convert_input_to_move(userInput);
-    if (!check_is_this_your_piece(cb, userMove, userSide)){
-        std::cout << "This piece is not yours, please choose your piece.\n";
-        return;
+        send("bestmove " + convert_move_to_str(best.bestMove));
     }
 
-    if (!check_rule(cb, userMove)){
-        std::cout << "Given move doesn't fit for rules, please re-enter.\n";
-        return;
+public:
+    UcciEngine(TranspositionTable& tt, const OpeningBook& book)
+        : tt(tt), book(book), board{}, sideToMove{ PS_DOWN }, uci{ false }, worker{}, stopSignal{ false }
+    {}
+
+    ~UcciEngine(){
+        stop_search();
     }
 
-    cb.move(userMove);
-    draw_board(cb);
+    // read and answer commands until "quit" or the end of stdin.
+    void run(){
+        std::string line;
+
+        while (std::getline(std::cin, line)){
+            std::istringstream in{ line };
+            std::string command;
+            in >> command;
+
+            if (command == "ucci" || command == "uci"){
+                uci = command == "uci";
+                send("id name Chinese_Chess_With_AI");
+                send(uci ? "option name Hash type spin default " + std::to_string(DEFAULT_TRANSPOSITION_TABLE_SIZE_MB) + " min 1 max " + std::to_string(MAX_TRANSPOSITION_TABLE_SIZE_MB)
+                         : "option hashsize type spin default " + std::to_string(DEFAULT_TRANSPOSITION_TABLE_SIZE_MB) + " min 1 max " + std::to_string(MAX_TRANSPOSITION_TABLE_SIZE_MB));
+                send(uci ? "uciok" : "ucciok");
+            }
+            else if (command == "isready"){
+                send("readyok");
+            }
+            else if (command == "setoption"){
+                stop_search();
+                set_option(in);
+            }
+            else if (command == "ucinewgame"){
+                stop_search();
+                tt.clear();
+            }
+            else if (command == "position"){
+                stop_search();
+                set_position(in);
+            }
+            else if (command == "go"){
+                stop_search();
+                GoLimits limits = parse_go(in);
+                MoveNode bookMove;
 
-    if (check_winner(cb) == userSide){
-        std::cout << "Congratulations! You win!\n";
-        running = false;
-        return;
+                if (!limits.infinite && book_probe(book, board, sideToMove, bookMove)){
+                    send("bestmove " + convert_move_to_str(bookMove));
+                }
+                else {
+                    stopSignal.store(false, std::memory_order_relaxed);
+                    worker = std::thread(&UcciEngine::search, this, limits);
+                }
+            }
+            else if (command == "stop"){
+                stop_search();
+            }
+            else if (command == "quit"){
+                stop_search();
+                send("bye");
+                return;
+            }
+        }
     }
+};
 
-    std::cout << "AI thinking...\n";
+/*
+    parse a number option of main(), only decimal digits up to maxValue are accepted.
+    return false if text is not such a number, value is unchanged then.
+*/
+bool parse_option_number(const char* text, uint32_t maxValue, uint32_t& value){
+    uint64_t number = 0;
+    if (*text == '\0'){
+        return false;
+    }
 
-    MoveNode aiMove = gen_best_move(cb, aiSide, searchDepth);
-    std::string aiMoveStr = convert_move_to_str(aiMove);
-    cb.move(aiMove);
-    draw_board(cb);
-    std::cout << "AI move: " << aiMoveStr
-                << ", piece is '" << piece_get_char(cb.get(aiMove.endRow, aiMove.endCol)) 
-                << "'.\n";
+    for (; *text != '\0'; ++text){
+        if (!std::isdigit(static_cast<unsigned char>(*text))){
+            return false;
+        }
 
-    if (check_winner(cb) == aiSide){
-        std::cout << "Game over! You lose!\n";
-        running = false;
-        return;
+        number = number * 10 + static_cast<uint64_t>(*text - '0');
+        if (number > maxValue){
+            return false;
+        }
     }
+
+    value = static_cast<uint32_t>(number);
+    return true;
 }
 
-void welcome() {
-    std::cout << "Welcome to this cnchess game, down side is you, upper is AI.\n";
-    std::cout << "You can type 'help' for more detail or just type 'h2e2' to begin.\n";
+void print_usage(){
+    std::cout << "usage: Chinese_Chess_With_AI [options]\n\n";
+    std::cout << "    --hash <MB>        transposition table size(1 ~ " << MAX_TRANSPOSITION_TABLE_SIZE_MB << "), default is " << DEFAULT_TRANSPOSITION_TABLE_SIZE_MB << ".\n";
+    std::cout << "    --threads <n>      AI searching threads(1 ~ " << MAX_SEARCH_THREADS << "), default is 1.\n";
+    std::cout << "    --movetime <ms>    the AI stops deepening after ms milliseconds, the difficulty still limits the depth.\n";
+    std::cout << "    --bench-smp <d>    benchmark lazy smp to depth d with 1, 2, 4 ... --threads threads, then exit.\n";
+    std::cout << "    --bench-search <d> benchmark move ordering, pvs, null move and lmr from the start position to depth 1, 2 ... d, then exit.\n";
+    std::cout << "    --perft <d>        count the leaf nodes to depth d with every root move's count and nodes/s, then exit.\n";
+    std::cout << "                       from the start position, the count is checked against the known one.\n";
+    std::cout << "    --fen <fen>        start --perft or --query-stats from this xiangqi FEN instead of the start position.\n";
+    std::cout << "    --moves <moves>    play the moves(like \"h2e2 h9g7\") before --perft or --query-stats.\n";
+    std::cout << "    --stats <format>   after every AI move, show the statistics of its search as 'text' or 'json'(one line).\n";
+    std::cout << "    --book <file>      play the moves of this opening book without searching while the position is in it.\n";
+    std::cout << "    --build-book <games> <file>\n";
+    std::cout << "                       build an opening book from the first " << BOOK_MAX_PLY << " moves of the games(one game a line,\n";
+    std::cout << "                       like \"h2e2 h9g7 h0g2\"), then exit.\n";
+    std::cout << "    --build-stats <games> <file>\n";
+    std::cout << "                       count every move of the first " << GAME_STATS_MAX_PLY << " moves of the games(one game a line, an optional\n";
+    std::cout << "                       result 1-0, 0-1 or 1/2-1/2 at the end) by position with --threads threads, then exit.\n";
+    std::cout << "    --query-stats <file>\n";
+    std::cout << "                       print the moves of the start position(or --fen, --moves) in the statistics, then exit.\n";
+    std::cout << "    --repetition <rule>\n";
+    std::cout << "                       how a repeated position is scored and the game ends on its third time, 'draw'(default),\n";
+    std::cout << "                       'check'(perpetual check loses) or 'chase'(perpetual check or chase loses).\n";
+    std::cout << "    --tb <file>        score the positions of this endgame tablebase exactly while searching.\n";
+    std::cout << "    --build-tb <material> <file>\n";
+    std::cout << "                       generate the endgame tablebase of a material(like \"KRkaabb\", red in upper case, up to\n";
+    std::cout << "                       " << TABLEBASE_MAX_PIECES << " pieces besides the generals) and every material it captures into, with --threads threads, then exit.\n";
+    std::cout << "    --no-ponder        don't search the AI's reply to your expected move while you think.\n";
+    std::cout << "    --ucci             run as an engine speaking UCCI(or UCI) on stdin and stdout.\n";
 }
 
-int main(){
+int main(int argc, char* argv[]){
     PieceSide userSide = PS_DOWN;
     PieceSide aiSide = PS_UP;
 
+    size_t hashSizeMB = DEFAULT_TRANSPOSITION_TABLE_SIZE_MB;
+    uint32_t threadCount = 1;
+    uint32_t timeLimitMs = 0;
+    uint16_t benchSmpDepth = 0;
+    uint16_t benchSearchDepth = 0;
+    int32_t perftDepth = -1;
+    std::string positionMoves;
+    std::string positionFen;
+    bool ucciMode = false;
+    StatsMode statsMode = SM_NONE;
+    std::string bookPath;
+    std::string buildBookGames;
+    std::string buildBookPath;
+    std::string buildStatsGames;
+    std::string buildStatsPath;
+    std::string queryStatsPath;
+    std::string tablebasePath;
+    std::string buildTablebaseMaterial;
+    std::string buildTablebasePath;
+    bool pondering = true;
+
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+
+        if (arg == "--hash" && i + 1 < argc){
+            uint32_t sizeMB = 0;
+            if (!parse_option_number(argv[++i], std::numeric_limits<uint32_t>::max(), sizeMB)){
+                print_usage();
+                return 1;
+            }
+
+            hashSizeMB = std::min(std::max<size_t>(sizeMB, 1), MAX_TRANSPOSITION_TABLE_SIZE_MB);
+        }
+        else if (arg == "--threads" && i + 1 < argc){
+            if (!parse_option_number(argv[++i], MAX_SEARCH_THREADS, threadCount) || threadCount == 0){
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--movetime" && i + 1 < argc){
+            if (!parse_option_number(argv[++i], std::numeric_limits<uint32_t>::max(), timeLimitMs)){
+                print_usage();
+                return 1;
+            }
+        }
+        else if ((arg == "--bench-smp" || arg == "--bench-search" || arg == "--perft") && i + 1 < argc){
+            uint32_t depth = 0;
+            if (!parse_option_number(argv[++i], MAX_SEARCH_PLY, depth)){
+                print_usage();
+                return 1;
+            }
+
+            if (arg == "--bench-smp"){
+                benchSmpDepth = static_cast<uint16_t>(depth);
+            }
+            else if (arg == "--bench-search"){
+                benchSearchDepth = static_cast<uint16_t>(depth);
+            }
+            else {
+                perftDepth = static_cast<int32_t>(depth);
+            }
+        }
+        else if (arg == "--fen" && i + 1 < argc){
+            positionFen = argv[++i];
+        }
+        else if (arg == "--moves" && i + 1 < argc){
+            positionMoves = argv[++i];
+        }
+        else if (arg == "--stats" && i + 1 < argc){
+            std::string format = argv[++i];
+            if (format != "text" && format != "json"){
+                print_usage();
+                return 1;
+            }
+
+            statsMode = format == "text" ? SM_TEXT : SM_JSON;
+        }
+        else if (arg == "--book" && i + 1 < argc){
+            bookPath = argv[++i];
+        }
+        else if (arg == "--build-book" && i + 2 < argc){
+            buildBookGames = argv[++i];
+            buildBookPath = argv[++i];
+        }
+        else if (arg == "--build-stats" && i + 2 < argc){
+            buildStatsGames = argv[++i];
+            buildStatsPath = argv[++i];
+        }
+        else if (arg == "--query-stats" && i + 1 < argc){
+            queryStatsPath = argv[++i];
+        }
+        else if (arg == "--repetition" && i + 1 < argc){
+            std::string rule = argv[++i];
+            if (rule != "draw" && rule != "check" && rule != "chase"){
+                print_usage();
+                return 1;
+            }
+
+            repetitionRule = rule == "draw" ? RR_DRAW : (rule == "check" ? RR_LONG_CHECK : RR_LONG_CHASE);
+        }
+        else if (arg == "--tb" && i + 1 < argc){
+            tablebasePath = argv[++i];
+        }
+        else if (arg == "--build-tb" && i + 2 < argc){
+            buildTablebaseMaterial = argv[++i];
+            buildTablebasePath = argv[++i];
+        }
+        else if (arg == "--no-ponder"){
+            pondering = false;
+        }
+        else if (arg == "--ucci"){
+            ucciMode = true;
+        }
+        else if (arg == "--help"){
+            print_usage();
+            return 0;
+        }
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!buildBookGames.empty()){
+        return build_opening_book(buildBookGames, buildBookPath, BOOK_MAX_PLY) ? 0 : 1;
+    }
+
+    if (!buildStatsGames.empty()){
+        return build_game_stats(buildStatsGames, buildStatsPath, threadCount) ? 0 : 1;
+    }
+
+    if (!buildTablebaseMaterial.empty()){
+        return build_endgame_tablebase(buildTablebaseMaterial, buildTablebasePath, threadCount) ? 0 : 1;
+    }
+
+    OpeningBook book;
+    if (!bookPath.empty() && !book.open(bookPath)){
+        std::cout << "--book " << bookPath << " is not a valid opening book.\n";
+        return 1;
+    }
+
+    if (!tablebasePath.empty() && !endgameTablebase.open(tablebasePath)){
+        std::cout << "--tb " << tablebasePath << " is not a valid endgame tablebase.\n";
+        return 1;
+    }
+
     ChessBoard cb;
+    TranspositionTable tt{ hashSizeMB };
+
+    if (ucciMode){
+        UcciEngine engine{ tt, book };
+        engine.run();
+        return 0;
+    }
+
+    if (benchSmpDepth != 0){
+        bench_lazy_smp(tt, benchSmpDepth, threadCount);
+        return 0;
+    }
+
+    if (benchSearchDepth != 0){
+        bench_search(tt, benchSearchDepth);
+        return 0;
+    }
+
+    if (perftDepth >= 0 || !queryStatsPath.empty()){
+        PieceSide side = PS_DOWN;
+        if (!positionFen.empty() && !board_set_fen(cb, positionFen, side)){
+            std::cout << "--fen is not a valid position.\n";
+            return 1;
+        }
+
+        side = play_moves(cb, side, positionMoves);
+        if (side == PS_EXTRA){
+            std::cout << "--moves has a move which is not legal.\n";
+            return 1;
+        }
+
+        if (!queryStatsPath.empty()){
+            return query_game_stats(queryStatsPath, cb, side) ? 0 : 1;
+        }
+
+        bool startPosition = side == PS_DOWN && cb.get_key() == ChessBoard{}.get_key();
+        return run_perft(cb, side, static_cast<uint16_t>(perftDepth), startPosition) ? 0 : 1;
+    }
+
     std::string userInput;
     uint16_t searchDepth = DEFAULT_AI_SEARCH_DEPTH;
     bool running = true;
+    Ponderer ponderer;
 
     welcome();
     draw_board(cb);
@@ -1318,6 +6031,7 @@ int main(){
             state_help(cb);
         }
         else if (userInput == "undo") {
+            ponderer.stop();
             state_undo(cb);
         }
         else if (userInput == "quit") {
@@ -1327,16 +6041,19 @@ int main(){
             return 0;
         }
         else if (userInput == "remake") {
+            ponderer.stop();
             state_remake(cb);
         }
         else if (userInput == "diff") {
+            ponderer.stop();
             state_diff(searchDepth);
         }
         else if (userInput == "advice") {
-            state_advice(cb, userSide, searchDepth);
+            ponderer.stop();
+            state_advice(cb, tt, book, userSide, searchDepth, threadCount, timeLimitMs);
         }
         else{
-            state_try_move(cb, userInput, userSide, aiSide, searchDepth, running);
+            state_try_move(cb, tt, book, ponderer, pondering, userInput, userSide, aiSide, searchDepth, threadCount, timeLimitMs, statsMode, running);
         }
     }
 